@@ -27,13 +27,17 @@
 int main(int argc, char *argv[])
 {
 	int i, rtime, rmem;
-	int opt, optconf;
+	int opt, optconf, nodes;
 	simos_list_node_t *n;
+	simos_sync_t *lock = NULL;
+	simos_chan_t *chan[4 * QTDE_PROCESS] = {NULL}; // threads too
 	simos_process_t *p;
 	simos_t *s = simos_new(QTDE_MEM);
 	simos_scheduler_conf_t *conf = create_scheduler_conf();
 	simos_memory_conf_t *mconf = create_memory_conf();
 	simos_process_t *proc;
+	simos_group_t *group[4] = {NULL};
+	int threads, tid = QTDE_PROCESS, j;
 
 	printf("Gerenciar memória com:\nMapa de bit? 1 = SIM / 0 = NAO ");
 	scanf("%1d", &optconf);
@@ -44,6 +48,15 @@ int main(int argc, char *argv[])
 		scanf("%1d", &optconf);
 		if(optconf){
 			mconf->list = 1;
+		} else {
+			printf("Paginacao sob demanda? 0 = NAO / 1 = FIFO / "
+					"2 = LRU / 3 = CLOCK / 4 = ARC ");
+			scanf("%1d", &optconf);
+			if (optconf) {
+				/* pages of 4 cells and a TLB of 16 entries */
+				mconf->paging = 1;
+				s->paging = simos_paging_create(s->mem, 4, optconf - 1, 16);
+			}
 		}
 	}
 
@@ -66,6 +79,88 @@ int main(int argc, char *argv[])
 			simos_memory_block_create(0, QTDE_MEM));
 	}
 
+	/* the processes not fitting wait for 64 bytes to be moved each tick */
+	if (! mconf->paging) {
+		printf("Compactacao incremental? 1 = SIM / 0 = NAO ");
+		scanf("%1d", &optconf);
+		if (optconf) {
+			mconf->compact = 1;
+			s->mem->compact = simos_memory_compact_create(64, 16);
+		}
+	}
+
+	/* a sample every 50 units of time, written to out_mem*.csv */
+	printf("Amostrar a fragmentacao? 1 = SIM / 0 = NAO ");
+	scanf("%1d", &optconf);
+	if (optconf) {
+		s->mem->stats->interval = 50;
+	}
+
+	/* 16 KiB L1 of 4 ways and 256 KiB L2 of 8 ways, lines of 64 bytes */
+	printf("Cache L1/L2? 0 = NAO / 1 = LRU / 2 = Pseudo-LRU ");
+	scanf("%1d", &optconf);
+	if (optconf) {
+		s->cache = simos_cache_create();
+		simos_cache_add_level(s->cache, 64, 4, 64, optconf - 1, 4);
+		simos_cache_add_level(s->cache, 512, 8, 64, optconf - 1, 12);
+	}
+
+	/* 2 for each switch, up to 20 more for a cache cold after 100 away */
+	printf("Custo de troca de contexto? 0 = NAO / 1 = SIM / "
+			"2 = Com afinidade ");
+	scanf("%1d", &optconf);
+	if (optconf) {
+		conf->switch_cost = 2;
+		conf->warmth_penalty = 20;
+		conf->warmth_halflife = 100;
+		conf->affinity = (optconf == 2) ? 4 : 0;
+	}
+
+
+	printf("Heap dinamico (brk/mmap)? 1 = SIM / 0 = NAO ");
+	scanf("%1d", &optconf);
+	if (optconf) {
+		s->mem->heap = simos_memory_heap_create(20, 40, 16);
+	}
+
+	printf("Area de troca (swap)? 1 = SIM / 0 = NAO ");
+	scanf("%1d", &optconf);
+	if (optconf) {
+		s->swap = simos_swap_create("./simos.swap", 4 * QTDE_MEM, 8, 20, 4);
+	}
+
+	printf("Nos NUMA? 0 = Nao / 2 = Dois / 4 = Quatro ");
+	scanf("%1d", &nodes);
+	if (nodes > 1) {
+		printf("Politica NUMA? 0 = Local / 1 = Intercalada / 2 = Fixa ");
+		scanf("%1d", &optconf);
+		s->numa = simos_numa_create(QTDE_MEM, nodes, NULL, optconf);
+	}
+
+	/* a tenant alone, another one with a quarter of the CPU at most */
+	printf("Grupos de processos? 1 = SIM / 0 = NAO ");
+	scanf("%1d", &optconf);
+	if (optconf) {
+		s->groups = simos_group_new(NULL, "/", 1024, 0, 0, 0);
+		group[0] = simos_group_new(s->groups, "a", 1024, 0, 0, 0);
+		group[1] = simos_group_new(s->groups, "b", 1024, 100, 400,
+				QTDE_MEM / 2);
+		group[2] = simos_group_new(group[1], "b0", 2048, 0, 0, 0);
+		group[3] = simos_group_new(group[1], "b1", 1024, 0, 0, 0);
+	}
+
+	printf("Governador de frequencia? 0 = NAO / 1 = Desempenho / "
+			"2 = Economia / 3 = Sob demanda ");
+	scanf("%1d", &optconf);
+	if (optconf) {
+		/* a CPU for each NUMA node, with 200 mW idle */
+		s->dvfs = simos_dvfs_create(s->numa ? s->numa->nnodes : 1, NULL, 0,
+				200, optconf - 1);
+	}
+
+	/* thread pools: up to 3 more threads, doing half the work each */
+	printf("Processos com varias threads? 1 = SIM / 0 = NAO ");
+	scanf("%1d", &threads);
 
 	srand(time(NULL));
 	for (i = 0; i < QTDE_PROCESS; i++) {
@@ -76,10 +171,22 @@ int main(int argc, char *argv[])
 
 		rmem = rand() % 10;
 		rmem += 10; // >=10 and <20
+		if (s->swap || mconf->compact || mconf->paging) {
+			rmem *= 2; // overcommit: about 1.5 times QTDE_MEM
+		}
 
 		proc = simos_process_create(i, rtime, rmem);
+		if (s->groups) {
+			proc->group = (i % 5 == 0) ? group[0] : group[2 + i % 2];
+		}
 		simos_add_process(s,proc, mconf);
 		printf("process %2d created\n", i);
+
+		for (j = 0; threads && j < i % 4; j++, tid++) {
+			simos_add_process(s, simos_thread_create(proc, tid, rtime / 2),
+					mconf);
+			printf("thread %3d of process %2d created\n", tid, i);
+		}
 	}
 	printf("\n\n");
 
@@ -92,33 +199,48 @@ int main(int argc, char *argv[])
 		printf(" | 3 - Shortest-Remaning-Time-First (SRTF)           |\n");
 		printf(" | 4 - Round-Robin                                   |\n");
 		printf(" | 5 - Fila prioridade                               |\n");
+		printf(" | 6 - Filas multinivel com realimentacao (MLFQ)     |\n");
+		printf(" | 7 - Completely Fair Scheduler (CFS)               |\n");
+		printf(" | 8 - Loteria                                       |\n");
+		printf(" | 9 - Stride                                        |\n");
+		printf(" | 10 - Earliest Deadline First (EDF)                |\n");
+		printf(" | 11 - Rate Monotonic (RM)                          |\n");
+		printf(" | 12 - Prioridade com envelhecimento                |\n");
+		printf(" | 13 - Round-Robin com E/S                          |\n");
+		printf(" | 14 - Prioridade com exclusao mutua                |\n");
+		printf(" | 15 - Round-Robin com pipelines                    |\n");
 		printf(" | 0 - Sair                                          |\n");
 		printf(" |                                                   |\n");
 		printf(" +===================================================+\n");
 		printf("  Opcao:");
-		scanf("%1d", &opt);
+		scanf("%2d", &opt);
 
-		if (opt < 1 || opt > 9) break;
+		if (opt < 1 || opt > 15) break;
 
 		switch(opt) {
 			case 1: //FCFS
 				simos_execute(s, conf, 1);
 				break;
 			case 2: //SJF
-				conf->sort_sjf = 1;
+				printf("Tempo previsto? 1 = SIM / 0 = Nao ");
+				scanf("%1d", &optconf);
+				conf->sort_sjf = optconf ? SIMOS_SORT_PREDICT : 1;
 				simos_execute(s, conf, 2);
 				break;
 			case 3: //SRTF
-				conf->sort_srtf = 1;
+				printf("Tempo previsto? 1 = SIM / 0 = Nao ");
+				scanf("%1d", &optconf);
+				conf->sort_srtf = optconf ? SIMOS_SORT_PREDICT : 1;
 				simos_execute(s, conf, 3);
 				break;
 
 
 			case 4: //RR
-				printf("Quanta diferentes? 1 = SIM / 0 = Nao ");
+				printf("Quanta diferentes? 1 = SIM / "
+						"2 = Adaptativo / 0 = Nao ");
 				scanf("%1d", &optconf);
 				if(optconf){
-					conf->auto_quantum = 1;
+					conf->auto_quantum = optconf;
 				} else {
 					printf("Com prioridade? 1 = SIM / 0 = Nao ");
 					scanf("%1d", &optconf);
@@ -144,6 +266,120 @@ int main(int argc, char *argv[])
 				}
 				simos_execute(s, conf, 5);
 				break;
+
+			case 6: //MLFQ
+				simos_execute(s, conf, 6);
+				break;
+
+			case 7: //CFS
+				printf("Com prioridade? 1 = SIM / 0 = Nao ");
+				scanf("%1d", &optconf);
+				if(optconf){
+					conf->priority = 1;
+				}
+				simos_execute(s, conf, 7);
+				break;
+
+			case 8: //lottery
+				simos_execute(s, conf, 8);
+				break;
+
+			case 9: //stride
+				simos_execute(s, conf, 9);
+				break;
+
+			case 10: //EDF
+			case 11: //RM
+				SIMOS_LIST_FOREACH(n, s->sched->ready) {
+					p = simos_node_to_process(n);
+					p->period = p->required_execution_time * 4;
+				}
+				simos_execute(s, conf, opt);
+				break;
+
+			case 12: //aging
+				conf->priority = 1;
+				simos_execute(s, conf, 12);
+				break;
+
+			case 13: //RR with I/O: 2 devices, mostly I/O bound
+				if (s->io == NULL) {
+					s->io = simos_io_create(2);
+				}
+
+				printf("Disco? 0 = Nao / 1 = FCFS / 2 = SSTF / "
+						"3 = SCAN / 4 = C-LOOK / 5 = Deadline ");
+				scanf("%1d", &optconf);
+				for (i = 0; i < s->io->ndev; i++) {
+					if (s->io->dev[i].disk) {
+						simos_disk_destroy(s->io->dev[i].disk);
+						s->io->dev[i].disk = NULL;
+					}
+					if (optconf) {
+						s->io->dev[i].disk = simos_disk_create(1024,
+								4, 64, optconf - 1);
+					}
+				}
+
+				printf("Sistema de arquivos? 1 = SIM / 0 = Nao ");
+				scanf("%1d", &optconf);
+				if (optconf && s->io->fs == NULL) {
+					s->io->fs = simos_fs_create("./simos.img", 16384,
+							QTDE_PROCESS, 256, SIMOS_FS_LRU);
+				} else if (! optconf && s->io->fs) {
+					simos_fs_destroy(s->io->fs);
+					s->io->fs = NULL;
+				}
+
+				SIMOS_LIST_FOREACH(n, s->sched->ready) {
+					p = simos_node_to_process(n);
+					p->cpu_burst = 10;
+					p->io_burst = s->io->dev[0].disk ? 8 : 40;
+					p->device = p->pid % 2;
+				}
+				simos_execute(s, conf, 13);
+				break;
+
+			case 14: //late arrivals, every other process shares a lock
+				printf("Heranca de prioridade? 1 = SIM / 0 = Nao ");
+				scanf("%1d", &optconf);
+				if (lock) {
+					simos_sync_destroy(lock);
+				}
+				lock = simos_mutex_new(optconf);
+
+				SIMOS_LIST_FOREACH(n, s->sched->ready) {
+					p = simos_node_to_process(n);
+					p->arrival_time = p->pid * 100;
+					p->lock = (p->pid % 2) ? NULL : lock;
+					p->cs_every = 40;
+					p->cs_len = 20;
+				}
+				conf->priority = 1;
+				simos_execute(s, conf, 14);
+				break;
+
+			case 15: //pipelines of 4 stages, an item every 10
+				printf("Fila de mensagens? 1 = SIM / 0 = Pipe ");
+				scanf("%1d", &optconf);
+
+				SIMOS_LIST_FOREACH(n, s->sched->ready) {
+					p = simos_node_to_process(n);
+					if (chan[p->pid]) {
+						simos_chan_destroy(chan[p->pid]);
+					}
+					chan[p->pid] = optconf ? simos_mq_new(4, 512)
+						: simos_pipe_new(4 * 512);
+				}
+				SIMOS_LIST_FOREACH(n, s->sched->ready) {
+					p = simos_node_to_process(n);
+					p->ipc_out = (p->pid % 4 < 3) ? chan[p->pid] : NULL;
+					p->ipc_in = (p->pid % 4) ? chan[p->pid - 1] : NULL;
+					p->ipc_every = 10;
+					p->ipc_size = 512;
+				}
+				simos_execute(s, conf, 15);
+				break;
 		}
 	}
 	simos_free(s);
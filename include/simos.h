@@ -23,6 +23,8 @@
 #ifndef SIMOS_H
 #define SIMOS_H
 
+#include <stdio.h>
+
 #ifdef	__cplusplus
 extern "C" {
 #endif
@@ -65,11 +67,15 @@ int simos_list_del(simos_list_t *list, simos_list_node_t *node);
 simos_list_node_t *simos_list_del_head(simos_list_t *list);
 /** Delete the very last node in the list. */
 simos_list_node_t *simos_list_del_tail(simos_list_t *list);
+/** Take a node known to be in the list out of it, O(1). */
+void simos_list_unlink(simos_list_t *list, simos_list_node_t *node);
 /** Delete all nodes in the list AND ALSO THE DATA. */
 void simos_list_free(simos_list_t *list);
 
 void simos_list_add_after(simos_list_t *list, simos_list_node_t *node,
 	simos_list_node_t *curr);
+/** Move every node of `other' to the tail of the list. */
+void simos_list_append(simos_list_t *list, simos_list_t *other);
 
 void swap_data(simos_list_node_t **a, int i, int j);
 
@@ -83,6 +89,7 @@ int (* p_partition)(simos_list_node_t **a, int p, int r,
 /** Get a member of the process in the simos_list_node_t*/
 int get_required_execution_time(simos_list_node_t *node);
 int get_remaining_time(simos_list_node_t *node);
+int get_burst_estimate(simos_list_node_t *node);
 int get_priority(simos_list_node_t *node);
 int get_pid(simos_list_node_t *node);
 
@@ -103,13 +110,120 @@ int simos_list_partition(simos_list_node_t **a, int p, int r,
 
 
 
+/***********************************************************************
+ * red-black tree declarations
+ **********************************************************************/
+
+/**
+ * A node is ordered by its key and, like simos_list_node, carries a void*
+ * pointer to any data wanted.
+ */
+struct simos_rb_node {
+	void *data;
+	size_t key;
+	struct simos_rb_node *left;
+	struct simos_rb_node *right;
+	struct simos_rb_node *parent;
+	int red;
+};
+typedef struct simos_rb_node simos_rb_node_t;
+
+typedef struct simos_rb_tree {
+	simos_rb_node_t *root;
+	/** Node with the smallest key. */
+	simos_rb_node_t *first;
+	size_t len;
+} simos_rb_tree_t;
+
+/** Create a new empty tree. */
+simos_rb_tree_t *simos_rb_new();
+/** Create a new node, ordered by key, data pointing to the parameter. */
+simos_rb_node_t *simos_rb_new_node(void *data, size_t key);
+/** Check whether the tree is empty. */
+int simos_rb_empty(simos_rb_tree_t *tree);
+/** Insert the node, O(log n). Equal keys keep the insertion order. */
+void simos_rb_insert(simos_rb_tree_t *tree, simos_rb_node_t *node);
+/** Delete the node, O(log n). The node is not freed. */
+void simos_rb_del(simos_rb_tree_t *tree, simos_rb_node_t *node);
+/** Node with the smallest key, O(1). */
+simos_rb_node_t *simos_rb_first(simos_rb_tree_t *tree);
+/** Node with the largest key. */
+simos_rb_node_t *simos_rb_last(simos_rb_tree_t *tree);
+/** Next and previous nodes in key order, NULL at the ends. */
+simos_rb_node_t *simos_rb_next(simos_rb_node_t *node);
+simos_rb_node_t *simos_rb_prev(simos_rb_node_t *node);
+/** First node whose key is not less than `key', NULL if none. */
+simos_rb_node_t *simos_rb_lower_bound(simos_rb_tree_t *tree, size_t key);
+
+
+
+/***********************************************************************
+ * heap declarations
+ **********************************************************************/
+
+typedef struct {
+	size_t key;
+	/** Insertion order, it breaks ties between equal keys. */
+	size_t seq;
+	void *data;
+} simos_heap_node_t;
+
+/** Binary min-heap of data ordered by key. */
+typedef struct {
+	simos_heap_node_t *nodes;
+	size_t len;
+	size_t size;
+	size_t seq;
+} simos_heap_t;
+
+/** Create a new empty heap. */
+simos_heap_t *simos_heap_new();
+/** Free the heap, not the data. */
+void simos_heap_free(simos_heap_t *heap);
+/** Check whether the heap is empty. */
+int simos_heap_empty(simos_heap_t *heap);
+/** Push data with the key, O(log n). */
+void simos_heap_push(simos_heap_t *heap, size_t key, void *data);
+/** Node with the smallest key, NULL if empty. O(1). */
+simos_heap_node_t *simos_heap_top(simos_heap_t *heap);
+/** Remove the node with the smallest key and return its data. */
+void *simos_heap_pop(simos_heap_t *heap);
+
+/** Fenwick tree: prefix sums of counts with O(log n) updates. */
+typedef struct {
+	size_t len;
+	size_t *tree;
+	size_t total;
+} simos_fenwick_t;
+
+/** Create a tree of `len' counts, all zero. */
+simos_fenwick_t *simos_fenwick_new(size_t len);
+void simos_fenwick_free(simos_fenwick_t *f);
+/** Add delta (may be negative) to the count at index i. */
+void simos_fenwick_add(simos_fenwick_t *f, size_t i, long delta);
+/** Smallest i such that the sum of counts 0..i is greater than target. */
+size_t simos_fenwick_find(simos_fenwick_t *f, size_t target);
+
+
+
 /***********************************************************************
  * process declarations
  **********************************************************************/
 #define QTDE_PROCESS 50
 
+/** Pages of a process, see paging declarations. */
+typedef struct simos_page_table simos_page_table_t;
+/** Mutexes, semaphores and condition variables, see sync declarations. */
+typedef struct simos_sync simos_sync_t;
+/** Pipes and message queues, see ipc declarations. */
+typedef struct simos_chan simos_chan_t;
+/** Transfers to and from the swap file, see swap declarations. */
+typedef struct simos_swap_req simos_swap_req_t;
+/** Groups of processes sharing CPU and memory, see group declarations. */
+typedef struct simos_group simos_group_t;
+
 /** Process information. */
-typedef struct {
+typedef struct simos_process {
 	/** Process' identifier. */
 	int pid;
 	/** Units of time required for executing the process. */
@@ -120,6 +234,9 @@ typedef struct {
 	size_t required_memory;
 	/** Memory pointer where the process was allocated in the memory. */
 	size_t memory_pointer;
+	/** Region mapped by the process apart from its block, -1 if none. */
+	size_t mmap_pointer;
+	size_t mmap_len;
 	/** Time at process' creation. */
 	size_t entry_time;
 	/** Time at process' tear down. */
@@ -131,13 +248,154 @@ typedef struct {
 	size_t priority;
 	/** Time of cpu */
 	size_t running_time;
+
+	/** Used by paging */
+	simos_page_table_t *pt;
+	/** Seed of the process' page reference string. */
+	unsigned int seed;
+	size_t page_faults;
+
+	/** Used by the cache: last address referenced, misses in the LLC. */
+	size_t address;
+	size_t cache_misses;
+
+	/** Time the process last left the CPU. */
+	size_t last_run;
+	/** Times dispatched after another process and the time it cost. */
+	size_t switches;
+	size_t switch_time;
+
+	/** Time the process shows up, used by policies with late arrivals. */
+	size_t arrival_time;
+	/** CFS: weighted running time. */
+	size_t vruntime;
+	/** Lottery and stride: share of the CPU, and stride's pass. */
+	size_t tickets;
+	size_t pass;
+	/** Aging: time the process reaches the top priority. */
+	size_t aging_key;
+
+	/**
+	 * Real-time task: a job of wcet units of time is released every
+	 * period (0: a single job) and must be done within deadline (0: the
+	 * period). A sporadic task waits up to one more period at random.
+	 */
+	size_t period;
+	size_t deadline;
+	size_t wcet;
+	int sporadic;
+	/** Current job: release, absolute deadline and work left. */
+	size_t release;
+	size_t abs_deadline;
+	size_t job_left;
+	size_t jobs;
+	size_t deadline_misses;
+
+	/** Predicted length of the next CPU burst and bursts seen so far. */
+	size_t burst_estimate;
+	size_t bursts;
+
+	/**
+	 * CPU bursts of about cpu_burst units of time, each one followed by
+	 * an I/O burst of about io_burst on the device (cpu_burst 0: no I/O).
+	 * On a disk io_burst counts sectors, from the last one read, sector.
+	 */
+	size_t cpu_burst;
+	size_t io_burst;
+	int device;
+	size_t sector;
+	/** Inode of the process' file (-1: none yet) and where it is at. */
+	int file;
+	size_t file_offset;
+
+	/**
+	 * Object the process is blocked on, first of the mutexes it holds,
+	 * its priority before inheriting any and the time spent blocked.
+	 */
+	simos_sync_t *waiting_on;
+	simos_sync_t *held;
+	size_t base_priority;
+	size_t sync_time;
+	/**
+	 * Critical sections: cs_len units of time holding `lock' every
+	 * cs_every units of time of CPU, cs_left of the current one.
+	 */
+	simos_sync_t *lock;
+	size_t cs_every;
+	size_t cs_len;
+	size_t cs_left;
+	/**
+	 * Pipeline stage: every ipc_every units of time of CPU the process
+	 * sends ipc_size bytes to ipc_out and then receives as much from
+	 * ipc_in, ipc_phase tells which of the two is done.
+	 */
+	simos_chan_t *ipc_in;
+	simos_chan_t *ipc_out;
+	size_t ipc_every;
+	size_t ipc_size;
+	int ipc_phase;
+	/** Transfer in progress: its data, the bytes left and done. */
+	char *ipc_data;
+	size_t ipc_left;
+	size_t ipc_done;
+	/** Row of the process in the banker's matrices, -1 if none. */
+	int bank_row;
+	/**
+	 * Where the process' block and mapped region are in the swap file
+	 * (-1: in memory), the transfer of them not completed yet and the
+	 * time spent waiting to be brought back in.
+	 */
+	size_t swap_slot;
+	simos_swap_req_t *swap_req;
+	size_t swap_time;
+	/** NUMA node whose CPUs run the process, -1 until admitted. */
+	int numa_node;
+	/** Group the process belongs to, NULL: the root. */
+	simos_group_t *group;
+	/** SIMOS_READY, SIMOS_RUNNING or SIMOS_BLOCKED. */
+	int state;
+	/** CPU left in the current burst and running_time at its start. */
+	size_t burst_left;
+	size_t burst_start;
+	/** Time spent blocked, waiting for the device or being served. */
+	size_t io_time;
+	/**
+	 * Process whose address space the thread runs in (itself for a
+	 * process) and, in that one, its threads counting itself, the CPU
+	 * they used and the time the last of them finished.
+	 */
+	struct simos_process *leader;
+	int nthreads;
+	size_t threads_time;
+	size_t done_time;
+	/** Energy spent running the process (uJ), see DVFS declarations. */
+	size_t energy;
 } simos_process_t;
 
+#define SIMOS_READY 0
+#define SIMOS_RUNNING 1
+#define SIMOS_BLOCKED 2
+
 /** Create a new process. */
 simos_process_t *simos_process_create(int pid, size_t required_execution_time,
 		size_t required_memory);
+/**
+ * New thread of `leader', scheduled on its own but sharing the memory,
+ * pages and group of the process. The process is done when all its
+ * threads are.
+ */
+simos_process_t *simos_thread_create(simos_process_t *leader, int tid,
+		size_t required_execution_time);
 /** Just call free (malloc(3)) in proc. */
 void simos_process_destroy(simos_process_t *proc);
+/**
+ * A CPU burst of `burst' units of time is over: update the prediction by
+ * exponential averaging, estimate = alpha% of burst + (100-alpha)% of
+ * estimate. The first burst replaces the initial guess.
+ */
+void simos_process_burst(simos_process_t *proc, size_t burst, int alpha);
+/** Length of a burst about `mean' long, from the process' own seed. */
+size_t simos_process_draw(simos_process_t *proc, size_t mean);
 /** Type cast in node->data to simos_process_t. */
 simos_process_t *simos_node_to_process(simos_list_node_t *node);
 
@@ -145,11 +403,91 @@ simos_process_t *simos_node_to_process(simos_list_node_t *node);
 /***********************************************************************
  * scheduler declararions
  **********************************************************************/
+/** Levels of the multilevel feedback queue, one bit each. */
+#define SIMOS_MLFQ_MAX 64
+/** sort_sjf and sort_srtf: by the predicted burst, not the real one. */
+#define SIMOS_SORT_PREDICT 2
+/** auto_quantum: tuned from the bursts seen (1 is 2 for even jobs). */
+#define SIMOS_QUANTUM_ADAPTIVE 2
+/** Devices and their requests, see I/O declarations. */
+typedef struct simos_io simos_io_t;
+/** Timers run as the time goes by, see timer declarations. */
+typedef struct simos_wheel simos_wheel_t;
+
+/** Bursts are counted by power of two, and halved every window. */
+#define SIMOS_BURST_HIST 32
+#define SIMOS_BURST_WINDOW 1024
+
 typedef struct {
 	int sort_sjf;
 	int sort_srtf;
 	int auto_quantum;
 	int priority;
+
+	/** Time charged whenever the CPU switches to another process. */
+	size_t switch_cost;
+	/**
+	 * Time charged to a process coming back with a cold cache. The
+	 * process keeps half of its warmth every warmth_halflife units of
+	 * time away from the CPU.
+	 */
+	size_t warmth_penalty;
+	size_t warmth_halflife;
+	/** Look this many processes ahead for a warmer one (0: off). */
+	int affinity;
+
+	/**
+	 * Multilevel feedback queue: a process using its whole quantum goes
+	 * one level down, every mlfq_boost units of time all go back to 0.
+	 */
+	int mlfq_levels;
+	size_t mlfq_quantum[SIMOS_MLFQ_MAX];
+	size_t mlfq_boost;
+
+	/**
+	 * Completely fair scheduler: every ready process runs once in
+	 * cfs_latency, for no less than cfs_granularity.
+	 */
+	size_t cfs_latency;
+	size_t cfs_granularity;
+
+	/** Lottery and stride: time a process runs on each turn. */
+	size_t share_quantum;
+
+	/** EDF and RM: no job is released from this time on. */
+	size_t rt_horizon;
+
+	/** Aging: waiting this long is worth one priority level. */
+	size_t aging_interval;
+
+	/** Weight in % of the last burst in the predicted one. */
+	int predict_alpha;
+	/**
+	 * Adaptive quantum: the smallest one letting quantum_percentile % of
+	 * the bursts seen finish in a single slice, and long enough to keep
+	 * switch_cost under 10% of it, up to quantum_max.
+	 */
+	int quantum_percentile;
+	size_t quantum_max;
+	size_t burst_hist[SIMOS_BURST_HIST];
+	size_t bursts;
+
+	/**
+	 * Called by the policies on every tick the CPU runs `proc', so the
+	 * rest of the system (memory compaction, ...) can do its own work.
+	 * Any time spent by the system must be added to *simostime.
+	 */
+	void (* tick)(void *arg, simos_process_t *proc, size_t *simostime);
+	void *tick_arg;
+	/** Where processes do their I/O bursts, NULL if nowhere. */
+	simos_io_t *io;
+	/** CFS shares the CPU among these groups first, NULL if none. */
+	simos_group_t *groups;
+	/**
+	 * Timers of the simulation, fired while the CPU idles too. NULL:
+	 * the real-time policies keep a wheel of their own.
+	 */
+	simos_wheel_t *timers;
 } simos_scheduler_conf_t;
 
 typedef struct {
@@ -164,6 +502,11 @@ void simos_process_list_add(simos_list_t *proclist, simos_process_t *proc);
 int simos_process_list_del(simos_list_t *proclist, int pid);
 /** Get the process with the refered pid. Return simos_process_t*. */
 simos_process_t *simos_process_list_get(simos_list_t *proclist, int pid);
+/** Tell the scheduler `p' ran a CPU burst of `burst' units of time. */
+void simos_scheduler_burst(simos_scheduler_conf_t *conf, simos_process_t *p,
+		size_t burst);
+/** Quantum for the bursts seen so far, see quantum_percentile. */
+size_t simos_adaptive_quantum(simos_scheduler_conf_t *conf);
 
     /*==========================================================*/
     /*-------- New policies must be implemented here... --------*/
@@ -174,10 +517,123 @@ void simos_run_rr(simos_list_t *ready, simos_list_t *finished,
 	simos_scheduler_conf_t *conf, size_t *simostime);
 void simos_run_queue(simos_list_t *ready, simos_list_t *finished,
 		simos_scheduler_conf_t *conf, size_t *simostime);
+void simos_run_mlfq(simos_list_t *ready, simos_list_t *finished,
+		simos_scheduler_conf_t *conf, size_t *simostime);
+void simos_run_cfs(simos_list_t *ready, simos_list_t *finished,
+		simos_scheduler_conf_t *conf, size_t *simostime);
+void simos_run_lottery(simos_list_t *ready, simos_list_t *finished,
+		simos_scheduler_conf_t *conf, size_t *simostime);
+void simos_run_stride(simos_list_t *ready, simos_list_t *finished,
+		simos_scheduler_conf_t *conf, size_t *simostime);
+
+#define SIMOS_RT_EDF 0
+#define SIMOS_RT_RM 1
+/**
+ * Utilisation test of the tasks in the list. Return true whether they are
+ * schedulable by the policy: U <= 1 for EDF, the hyperbolic bound
+ * prod(U_i + 1) <= 2 for RM (sufficient only). The utilisation goes to u.
+ */
+int simos_rt_schedulable(simos_list_t *tasks, int policy, double *u);
+void simos_run_edf(simos_list_t *ready, simos_list_t *finished,
+		simos_scheduler_conf_t *conf, size_t *simostime);
+void simos_run_rm(simos_list_t *ready, simos_list_t *finished,
+		simos_scheduler_conf_t *conf, size_t *simostime);
+void simos_run_aging(simos_list_t *ready, simos_list_t *finished,
+		simos_scheduler_conf_t *conf, size_t *simostime);
+void simos_run_io(simos_list_t *ready, simos_list_t *finished,
+		simos_scheduler_conf_t *conf, size_t *simostime);
+/**
+ * Priority scheduling of processes taking their lock every cs_every units
+ * of time (see simos_process_t), blocked ones wait on it.
+ */
+void simos_run_sync(simos_list_t *ready, simos_list_t *finished,
+		simos_scheduler_conf_t *conf, size_t *simostime);
+/**
+ * Round-Robin of pipeline stages sending and receiving through their
+ * channels (see simos_process_t), blocked ones wait on them. The channels
+ * start empty, and the ones still waiting at the end are deadlocked.
+ */
+void simos_run_ipc(simos_list_t *ready, simos_list_t *finished,
+		simos_scheduler_conf_t *conf, size_t *simostime);
 
 simos_scheduler_conf_t *create_scheduler_conf();
 
 
+
+/***********************************************************************
+ * group declarations
+ **********************************************************************/
+
+/**
+ * A tree of process groups, like the control groups of Linux. Siblings
+ * share the CPU of their parent by weight and a group may run no more
+ * than `quota' units of time every `period'. The memory of the processes
+ * in a group and below it is charged to the group, up to `mem_limit'.
+ */
+struct simos_group {
+	char name[16];
+	struct simos_group *parent;
+	/** First child and next sibling. */
+	struct simos_group *child;
+	struct simos_group *sibling;
+
+	/** Share among the siblings, 1024: as much as a process. */
+	size_t weight;
+	/** 0: no quota, no memory limit. */
+	size_t quota;
+	size_t period;
+	size_t mem_limit;
+	size_t mem_usage;
+
+	/**
+	 * CFS: ready processes and groups with ready processes, by
+	 * vruntime. The group is in its parent's `kids' (whether queued)
+	 * by its own vruntime, advancing as its processes run.
+	 */
+	simos_rb_tree_t *procs;
+	simos_rb_tree_t *kids;
+	simos_rb_node_t rb;
+	int queued;
+	size_t vruntime;
+	size_t min_vruntime;
+	/** Weight of the processes and groups queued. */
+	size_t load;
+	/** Time run in the current period, which started at period_start. */
+	size_t used;
+	size_t period_start;
+	int throttled;
+
+	/** Statistics */
+	size_t cpu_time;
+	size_t throttles;
+	size_t mem_peak;
+	size_t mem_failures;
+};
+
+/**
+ * Create a group under the parent (NULL: the root) with no processes.
+ * quota 0: no CPU limit (the root has none), mem_limit 0: no memory limit.
+ */
+simos_group_t *simos_group_new(simos_group_t *parent, const char *name,
+		size_t weight, size_t quota, size_t period, size_t mem_limit);
+/** Free the group and the groups below, not the processes. */
+void simos_group_destroy(simos_group_t *g);
+/**
+ * Charge `len' cells to the group and the ones above. Return true, or
+ * false and charge nothing if some limit would be exceeded.
+ */
+int simos_group_charge(simos_group_t *g, size_t len);
+/** Give back `len' cells charged to the group. */
+void simos_group_uncharge(simos_group_t *g, size_t len);
+/**
+ * The group (and the ones above) ran `ran' units of time by `now'.
+ * Return the highest group out of its quota for the period, NULL if none.
+ */
+simos_group_t *simos_group_run(simos_group_t *g, size_t ran, size_t now);
+/** Forget the CPU time and the CFS state of the group and the ones below. */
+void simos_group_reset(simos_group_t *g);
+
+
 /***********************************************************************
  * Memory management functions
  **********************************************************************/
@@ -197,17 +653,128 @@ typedef struct {
 	size_t blocklen;
 } simos_memory_block_t;
 
+/** A live allocation: where the owner keeps its pointer and length. */
+typedef struct {
+	size_t *pointer;
+	size_t *length;
+} simos_memory_area_t;
+
+/**
+ * State of an incremental compaction: live allocations are slided to the
+ * bottom of the memory, at most `budget' bytes on each tick.
+ */
+typedef struct {
+	/** Bytes moved at most on each scheduling tick. */
+	size_t budget;
+	/** Bytes moved per unit of simulated time. */
+	size_t bandwidth;
+
+	/** Blocks and mapped regions of the live processes, by address. */
+	simos_memory_area_t *areas;
+	size_t nareas;
+	/** Index in areas of the one being relocated. */
+	size_t curr;
+	/** Where the current area is going to. */
+	size_t target;
+	/** Bytes of the current area already relocated. */
+	size_t moved;
+	/** Lowest cell not yet claimed by a compacted area. */
+	size_t dest;
+	int running;
+
+	/** Statistics: bytes moved and simulated time spent. */
+	size_t bytes_moved;
+	size_t cost;
+	/** Bytes moved but not charged yet (less than bandwidth). */
+	size_t pending;
+} simos_memory_compact_t;
+
+/** Buckets of the free extent histogram: [2^i, 2^(i+1)) cells. */
+#define SIMOS_MEMORY_HIST 16
+
+/** Fragmentation metrics at a given time. */
+typedef struct {
+	size_t time;
+	/** Free cells. */
+	size_t free;
+	/** Length of the largest free extent. */
+	size_t largest;
+	/** Number of free extents. */
+	size_t extents;
+	/** External fragmentation: 1 - largest / free. */
+	double fragmentation;
+	size_t hist[SIMOS_MEMORY_HIST];
+} simos_memory_sample_t;
+
+/**
+ * Free extents of the memory, kept up to date on every alloc/free.
+ *
+ * Each free extent has its length written on its first and last cells
+ * (boundary tags), so an alloc or free finds and merges the neighbour
+ * extents without scanning the cells.
+ */
+typedef struct {
+	/** Boundary tags, one for each cell. */
+	size_t *tag;
+	/** Number of free extents of each length, 0..size. */
+	size_t *count;
+	/** One bit for each length with count > 0. */
+	unsigned long *lengths;
+
+	size_t free;
+	size_t extents;
+	size_t largest;
+	size_t hist[SIMOS_MEMORY_HIST];
+
+	/** Time series: one sample every `interval' units of time (0: off). */
+	size_t interval;
+	size_t next;
+	simos_memory_sample_t *samples;
+	size_t nsamples;
+	size_t maxsamples;
+} simos_memory_stats_t;
+
+/**
+ * Processes resizing their memory as they run: every `every' units of
+ * time of CPU a process moves its break (its block) or resizes its mapped
+ * region, up to `max' bytes each. A block grows in place whether the
+ * cells after it are free, otherwise it is relocated.
+ */
+typedef struct {
+	size_t every;
+	size_t max;
+	/** Bytes relocated per unit of simulated time. */
+	size_t bandwidth;
+
+	/** Statistics */
+	size_t resizes;
+	size_t in_place;
+	size_t relocations;
+	size_t failures;
+	size_t bytes_moved;
+	/** Bytes moved but not charged yet (less than bandwidth). */
+	size_t pending;
+} simos_memory_heap_t;
+
 #define QTDE_MEM 1024 //QTDE_MEM >= QTDE_PROCESS * 20
 typedef struct {
 	size_t size;
 	unsigned char *cells;
 	simos_memory_bmp_t *bmp;
 	simos_list_t *lmem;
+	simos_memory_compact_t *compact;
+	simos_memory_stats_t *stats;
+	/** Resizes during the execution, NULL whether off. */
+	simos_memory_heap_t *heap;
 } simos_memory_t;
 
 typedef struct {
 	int bmp;
 	int list;
+	/** Compact the memory when a process does not fit. */
+	int compact;
+	/** Demand paging instead of contiguous allocation. */
+	int paging;
 } simos_memory_conf_t;
 
 simos_memory_conf_t *create_memory_conf();
@@ -235,7 +802,10 @@ size_t simos_memory_list_alloc(simos_memory_t *mem, size_t blocklen);
 /** Generic memory allocator*/
 size_t (* p_simos_memory_alloc)(simos_memory_t *mem, size_t block);
 
-/** allocator */
+/**
+ * allocator: take `block' cells at `poiter'. Return -1, taking nothing,
+ * whether they are not all free.
+ */
 size_t allocator(simos_memory_t *mem, size_t poiter, size_t block);
 
 
@@ -250,6 +820,1048 @@ size_t simos_memory_alloc(simos_memory_t *mem, size_t block);
 void simos_memory_free(simos_memory_t *mem, size_t pointer, size_t length);
 
 
+/** fragmentation metrics */
+/**
+ * Account cells [pointer, pointer+length) as allocated. Return 0, leaving
+ * the stats alone, whether they are not all in one free extent.
+ */
+int simos_memory_stats_alloc(simos_memory_t *mem, size_t pointer,
+		size_t length);
+/** Account cells [pointer, pointer+length) as free. */
+void simos_memory_stats_free(simos_memory_t *mem, size_t pointer,
+		size_t length);
+/** External fragmentation of the memory right now. */
+double simos_memory_fragmentation(simos_memory_t *mem);
+/** Take a sample whether `interval' units of time elapsed. */
+void simos_memory_stats_sample(simos_memory_t *mem, size_t now);
+/** Forget the samples taken so far. */
+void simos_memory_stats_reset(simos_memory_t *mem);
+/** Write the samples as csv. */
+void simos_memory_stats_write(simos_memory_t *mem, FILE *f);
+
+
+/** compaction */
+simos_memory_compact_t *simos_memory_compact_create(size_t budget,
+		size_t bandwidth);
+void simos_memory_compact_destroy(simos_memory_compact_t *c);
+/**
+ * Track the blocks and mapped regions of the processes in the list as
+ * live allocations to be relocated.
+ */
+void simos_memory_compact_add(simos_memory_t *mem, simos_list_t *procs);
+/** Start relocating the tracked processes. */
+void simos_memory_compact_start(simos_memory_t *mem);
+/**
+ * Relocate at most `budget' bytes. Return the simulated time spent moving
+ * them. Once every area is moved, bmp and lmem are rebuilt.
+ */
+size_t simos_memory_compact_step(simos_memory_t *mem);
+
+
+/** brk and mmap */
+simos_memory_heap_t *simos_memory_heap_create(size_t every, size_t max,
+		size_t bandwidth);
+void simos_memory_heap_destroy(simos_memory_heap_t *heap);
+/**
+ * Resize the block at *pointer to `length' cells (0: free it; *pointer -1:
+ * a new one), in place or elsewhere. Elsewhere is found by the allocator
+ * of the memory (p_simos_memory_alloc: bit map, list or first fit), which
+ * marks the whole new block taken. Return the cells copied, or -1 if it
+ * does not fit anywhere: the block is left as it was.
+ */
+size_t simos_memory_resize(simos_memory_t *mem, size_t *pointer,
+		size_t *length, size_t new_length);
+/** Move the break of the process: its block becomes `length' long. */
+size_t simos_memory_brk(simos_memory_t *mem, simos_process_t *proc,
+		size_t length);
+/** Map, resize (like mremap) or unmap (length 0) the process' region. */
+size_t simos_memory_mmap(simos_memory_t *mem, simos_process_t *proc,
+		size_t length);
+/** Rebuild the bit map and the list from the cells. */
+void simos_memory_resync(simos_memory_t *mem);
+/**
+ * The cells [pointer, pointer+length) were taken or freed: bring the
+ * units of the bit map and the blocks of the list over them up to date.
+ */
+void simos_memory_resync_range(simos_memory_t *mem, size_t pointer,
+		size_t length);
+/**
+ * Resize the process asks for on this tick, if any: its region (map) or
+ * its block, to `len' cells. Return true or false.
+ */
+int simos_memory_heap_request(simos_memory_t *mem, simos_process_t *proc,
+		int *map, size_t *len);
+/** Carry out a request. Return the simulated time spent. */
+size_t simos_memory_heap_resize(simos_memory_t *mem, simos_process_t *proc,
+		int map, size_t len);
+/** Resize requests of a tick. Return the simulated time spent. */
+size_t simos_memory_heap_tick(simos_memory_t *mem, simos_process_t *proc);
+
+
+
+/***********************************************************************
+ * swap declarations
+ **********************************************************************/
+#define SIMOS_SWAP_OUT 0
+#define SIMOS_SWAP_IN 1
+
+/** A whole process going to or coming from the swap file. */
+struct simos_swap_req {
+	int dir;
+	/** NULL when the process came back before the page-out was over. */
+	simos_process_t *proc;
+	/** Slots in the file: the process' block, then its mapped region. */
+	size_t slot;
+	size_t len;
+	/** Page-out: copy of the cells until it is written (swap cache). */
+	unsigned char *data;
+	/** When the device is done with it, -1 while not submitted. */
+	size_t done_at;
+	simos_list_node_t node;
+};
+
+/**
+ * Processes evicted from the memory to a backing file, one slot of the
+ * file for each cell. Page-outs are queued and written `batch' at a time,
+ * sorted by slot, each run of contiguous slots in a single pwritev(2);
+ * a page-in is read right away. The device serves what is submitted in
+ * order and completes the requests later on.
+ */
+typedef struct {
+	int fd;
+	size_t size;
+	unsigned char *map;
+	/** Page-outs not submitted yet. */
+	simos_list_t *queue;
+	size_t queued;
+	size_t batch;
+	/** Submitted requests, by completion time, and when they are done. */
+	simos_list_t *inflight;
+	size_t busy_until;
+	/** Device time: for each run of slots, and slots per unit of time. */
+	size_t latency;
+	size_t bandwidth;
+
+	/** Processes which may be swapped out, least recently run first. */
+	simos_process_t **procs;
+	size_t nprocs;
+	/** Next process to look at for a page-in ahead of time. */
+	size_t hand;
+
+	/** Statistics */
+	size_t outs;
+	size_t ins;
+	size_t cached;
+	size_t prefetches;
+	size_t cells_out;
+	size_t cells_in;
+	size_t runs;
+	size_t batches;
+	size_t stall;
+	size_t failures;
+} simos_swap_t;
+
+/**
+ * Create a swap file of `size' slots at path. The file is unlinked right
+ * away, it lives as long as the swap. NULL on failure.
+ */
+simos_swap_t *simos_swap_create(const char *path, size_t size, size_t batch,
+		size_t latency, size_t bandwidth);
+/** Complete every transfer and close the file. */
+void simos_swap_destroy(simos_swap_t *swap);
+/** Let the process be swapped out to make room for others. */
+void simos_swap_add(simos_swap_t *swap, simos_process_t *proc);
+/** Swap out the least recently run process but `keep'. True or false. */
+int simos_swap_evict(simos_swap_t *swap, simos_memory_t *mem,
+		simos_process_t *keep, size_t now);
+/**
+ * Allocate `len' cells, swapping out the least recently run processes
+ * (but `keep') until they fit. Return the pointer, -1 if they never do.
+ */
+size_t simos_swap_alloc(simos_swap_t *swap, simos_memory_t *mem, size_t len,
+		simos_process_t *keep, size_t now);
+/** Queue the page-out of the whole process. Return true or false. */
+int simos_swap_out(simos_swap_t *swap, simos_memory_t *mem,
+		simos_process_t *proc, size_t now);
+/**
+ * Bring the process back in, from the swap cache or by a read completing
+ * later on. Return true or false whether there is no room for it.
+ */
+int simos_swap_in(simos_swap_t *swap, simos_memory_t *mem,
+		simos_process_t *proc, size_t now);
+/** Complete the transfers done by `now'. */
+void simos_swap_complete(simos_swap_t *swap, size_t now);
+/**
+ * The process holds the CPU: bring it in if it is out, read ahead while
+ * the device is idle. Return the time the process waits for its page-in.
+ */
+size_t simos_swap_tick(simos_swap_t *swap, simos_memory_t *mem,
+		simos_process_t *proc, size_t now);
+/** Complete every transfer, the device clock starts again. */
+void simos_swap_drain(simos_swap_t *swap);
+/** Forget the statistics. */
+void simos_swap_reset(simos_swap_t *swap);
+
+
+
+/***********************************************************************
+ * NUMA declarations
+ **********************************************************************/
+#define SIMOS_NUMA_MAX 8
+/** Distance of a node to itself, as in the ACPI SLIT. */
+#define SIMOS_NUMA_NEAR 10
+
+/** Where the memory of a process goes. */
+#define SIMOS_NUMA_LOCAL 0 // its own node first, then the nearest ones
+#define SIMOS_NUMA_INTERLEAVE 1 // each allocation on the next node
+#define SIMOS_NUMA_BIND 2 // its own node only
+
+/** A node owns the cells [base, base + size) of the memory. */
+typedef struct {
+	size_t base;
+	size_t size;
+	/** Execution time required by the processes running on it. */
+	size_t load;
+
+	/** Statistics: allocations, of them served by another node. */
+	size_t allocs;
+	size_t fallbacks;
+	size_t failures;
+} simos_numa_node_t;
+
+/**
+ * The memory split into nodes, each with its own allocator: a first fit
+ * over its cells (aligned on the units of the bit map, if any), which
+ * keeps the bit map and the list of the memory up to date.
+ */
+typedef struct {
+	int nnodes;
+	simos_numa_node_t node[SIMOS_NUMA_MAX];
+	/** distance[i * nnodes + j]: from the CPUs of i to the memory of j. */
+	int *distance;
+	int policy;
+	/** Node of the next interleaved allocation. */
+	int next_mem;
+	/**
+	 * Share of the time (%) a process spends accessing memory. Memory
+	 * at distance d makes it d / SIMOS_NUMA_NEAR times as slow.
+	 */
+	size_t memory_bound;
+	/** Thousandths of a unit of time not charged yet. */
+	size_t pending;
+
+	/** Statistics: ticks run on local and remote memory, their cost. */
+	size_t local;
+	size_t remote;
+	size_t cost;
+} simos_numa_t;
+
+/**
+ * Split a memory of `size' cells into nnodes nodes, distance as in
+ * simos_numa_t or NULL: nodes in a ring, 21 to the neighbours and 11
+ * more for every other hop.
+ */
+simos_numa_t *simos_numa_create(size_t size, int nnodes, const int *distance,
+		int policy);
+void simos_numa_destroy(simos_numa_t *numa);
+/** Node owning the cell, -1 if none. */
+int simos_numa_node_of(simos_numa_t *numa, size_t pointer);
+/** Distance from the CPUs of `from' to the memory of `to'. */
+int simos_numa_distance(simos_numa_t *numa, int from, int to);
+/**
+ * Allocate `len' cells for the process by the policy, giving it the least
+ * loaded node to run on if it has none. Return the pointer, -1 if they do
+ * not fit.
+ */
+size_t simos_numa_alloc(simos_numa_t *numa, simos_memory_t *mem,
+		simos_process_t *proc, size_t len);
+/** Cells taken on the node. */
+size_t simos_numa_used(simos_numa_t *numa, simos_memory_t *mem, int node);
+/** The process runs a tick. Return the time its remote accesses cost. */
+size_t simos_numa_tick(simos_numa_t *numa, simos_process_t *proc);
+/** Forget the statistics of the accesses, not of the allocations. */
+void simos_numa_reset(simos_numa_t *numa);
+
+
+
+/***********************************************************************
+ * DVFS declarations
+ **********************************************************************/
+#define SIMOS_DVFS_MAX 8
+#define SIMOS_DVFS_CPUS 8
+
+/** How the frequency of a CPU is chosen. */
+#define SIMOS_DVFS_PERFORMANCE 0 // the highest level
+#define SIMOS_DVFS_POWERSAVE 1 // the lowest level
+#define SIMOS_DVFS_ONDEMAND 2 // by the load of the last sampling period
+
+/** Operating point: frequency (MHz) and power (mW) running at it. */
+typedef struct {
+	size_t freq;
+	size_t power;
+} simos_dvfs_level_t;
+
+typedef struct {
+	/** Current level and the load seen since window_start. */
+	int level;
+	size_t window_start;
+	size_t window_busy;
+	/** Thousandths of a unit of time not charged yet. */
+	size_t pending;
+
+	/**
+	 * Statistics: time running processes, at each level, energy (uJ,
+	 * mW by units of time) it took and changes of level.
+	 */
+	size_t busy;
+	size_t time_at[SIMOS_DVFS_MAX];
+	size_t energy;
+	size_t transitions;
+} simos_dvfs_cpu_t;
+
+/**
+ * Frequency scaling of the CPUs. A unit of running_time is a tick at the
+ * highest frequency, at a lower one the tick takes longer. The CPU of a
+ * process is its NUMA node, the first one without NUMA.
+ */
+typedef struct {
+	/** Levels, from the slowest to the fastest. */
+	int nlevels;
+	simos_dvfs_level_t level[SIMOS_DVFS_MAX];
+	/** Power of a CPU with no process to run. */
+	size_t idle_power;
+	int ncpus;
+	simos_dvfs_cpu_t cpu[SIMOS_DVFS_CPUS];
+	int governor;
+	/**
+	 * Ondemand: every `sampling' units of time a CPU busier than
+	 * up_threshold% goes to the highest level, otherwise to the lowest
+	 * one which would keep it just under that.
+	 */
+	size_t sampling;
+	size_t up_threshold;
+	/** Time the statistics started. */
+	size_t start;
+} simos_dvfs_t;
+
+/**
+ * `ncpus' CPUs with the levels (or NULL: 800 to 2400 MHz, the power
+ * growing with the square of the voltage) under the governor.
+ */
+simos_dvfs_t *simos_dvfs_create(int ncpus, const simos_dvfs_level_t *levels,
+		int nlevels, size_t idle_power, int governor);
+void simos_dvfs_destroy(simos_dvfs_t *dvfs);
+/**
+ * The process runs a tick on its CPU. Charge the energy to it and return
+ * the time the tick takes over the one at the highest frequency.
+ */
+size_t simos_dvfs_tick(simos_dvfs_t *dvfs, simos_process_t *proc, size_t now);
+/** Energy spent by the CPUs until `now', idle ones included. */
+size_t simos_dvfs_energy(simos_dvfs_t *dvfs, size_t now);
+/** Forget the statistics and put the CPUs back at their first level. */
+void simos_dvfs_reset(simos_dvfs_t *dvfs, size_t now);
+
+
+
+/***********************************************************************
+ * paging declarations
+ **********************************************************************/
+
+/** Replacement policies. */
+#define SIMOS_PAGE_FIFO 0
+#define SIMOS_PAGE_LRU 1
+#define SIMOS_PAGE_CLOCK 2
+#define SIMOS_PAGE_ARC 3
+
+/** Intrusive circular list: the head is a sentinel link. */
+typedef struct simos_page_link {
+	struct simos_page_link *prev;
+	struct simos_page_link *next;
+} simos_page_link_t;
+
+typedef struct {
+	simos_page_link_t head;
+	size_t len;
+} simos_page_list_t;
+
+/** Page table entry. */
+typedef struct simos_pte {
+	int pid;
+	size_t vpn;
+	size_t frame;
+	int present;
+	int referenced;
+	int dirty;
+	/** Shared since a fork: a write copies the page first. */
+	int cow;
+	/** ARC list the page is in (ghosts included). */
+	int arc;
+	/** Link in the ARC ghost lists B1 and B2. */
+	simos_page_link_t ghost;
+	/** Next page mapping the same frame. */
+	struct simos_pte *rmap_next;
+} simos_pte_t;
+
+struct simos_page_table {
+	size_t npages;
+	/** Page last referenced, the reference string walks around it. */
+	size_t last;
+	simos_pte_t *pte;
+};
+
+/** Physical frame: `page_size' cells of mem->cells. */
+typedef struct {
+	/**
+	 * Pages mapping the frame (reverse map, through rmap_next), NULL
+	 * whether free. The first one carries the replacement state.
+	 */
+	simos_pte_t *pte;
+	size_t mapcount;
+	/** Link in the free list or in the policy's lists. */
+	simos_page_link_t link;
+} simos_frame_t;
+
+typedef struct {
+	int pid;
+	size_t vpn;
+	size_t frame;
+	int valid;
+} simos_tlb_entry_t;
+
+typedef struct {
+	simos_memory_t *mem;
+	int policy;
+	size_t page_size;
+	size_t nframes;
+	simos_frame_t *frames;
+	simos_page_list_t free;
+
+	/** FIFO and LRU queue, or ARC's T1 (recency). */
+	simos_page_list_t t1;
+	/** ARC's T2 (frequency) and ghost lists B1 and B2. */
+	simos_page_list_t t2;
+	simos_page_list_t b1;
+	simos_page_list_t b2;
+	/** ARC's target length of T1. */
+	size_t arc_p;
+	/** CLOCK's hand. */
+	size_t hand;
+
+	/** Tagged by pid, so it survives context switches. */
+	simos_tlb_entry_t *tlb;
+	size_t tlb_size;
+
+	/** Reference string: references per tick, % near the last page, % writes. */
+	size_t refs_per_tick;
+	size_t locality;
+	size_t writes;
+
+	/** Costs in cycles, charged to the simulated time per cycles_per_tick. */
+	size_t tlb_miss_cost;
+	size_t fault_cost;
+	size_t writeback_cost;
+	size_t copy_cost;
+	size_t cycles_per_tick;
+	size_t cycles;
+
+	/** Statistics */
+	size_t accesses;
+	size_t tlb_misses;
+	size_t faults;
+	size_t evictions;
+	size_t cow_copies;
+} simos_paging_t;
+
+/** Carve the memory into frames of `page_size' cells. */
+simos_paging_t *simos_paging_create(simos_memory_t *mem, size_t page_size,
+		int policy, size_t tlb_size);
+void simos_paging_destroy(simos_paging_t *pg);
+/** Create the (empty) page table of the process. */
+void simos_paging_add_process(simos_paging_t *pg, simos_process_t *proc);
+/**
+ * Give the child a page table mapping the frames of the parent's
+ * resident pages, shared and copied on write by either of them.
+ */
+void simos_paging_fork(simos_paging_t *pg, simos_process_t *parent,
+		simos_process_t *child);
+/** Give back frames and page table of the process. */
+void simos_paging_release(simos_paging_t *pg, simos_process_t *proc);
+/** Resident pages of the process and how many it shares with others. */
+void simos_paging_footprint(simos_paging_t *pg, simos_process_t *proc,
+		size_t *resident, size_t *shared);
+/** Next page of the process' reference string. */
+size_t simos_paging_reference(simos_paging_t *pg, simos_process_t *proc);
+/** Access a page. Return the cycles spent in TLB misses and faults. */
+size_t simos_paging_access(simos_paging_t *pg, simos_process_t *proc,
+		size_t vpn, int write);
+/** Run the references of a tick. Return the simulated time spent. */
+size_t simos_paging_tick(simos_paging_t *pg, simos_process_t *proc);
+
+
+
+/***********************************************************************
+ * cache declarations
+ **********************************************************************/
+#define SIMOS_CACHE_LRU 0
+/** Tree pseudo-LRU, the number of ways must be a power of 2. */
+#define SIMOS_CACHE_PLRU 1
+
+#define SIMOS_CACHE_LEVELS 3
+#define SIMOS_CACHE_INVALID 0xffffffffU
+
+typedef struct {
+	size_t sets;
+	size_t ways;
+	size_t line_size;
+	int policy;
+	/** Cycles to hit in this level. */
+	size_t latency;
+
+	/** Tags of a set are contiguous, so the ways are compared at once. */
+	unsigned int *tags;
+	/** LRU: time of the last use of each line. */
+	unsigned int *stamp;
+	unsigned int clock;
+	/** PLRU: ways-1 tree bits for each set. */
+	unsigned long *tree;
+
+	size_t hits;
+	size_t misses;
+} simos_cache_level_t;
+
+typedef struct {
+	int nlevels;
+	simos_cache_level_t level[SIMOS_CACHE_LEVELS];
+	/** Cycles to reach the memory after missing every level. */
+	size_t memory_latency;
+
+	/** Address stream: accesses per tick, % sequential, bytes per cell. */
+	size_t accesses_per_tick;
+	size_t locality;
+	size_t bytes_per_cell;
+
+	/** Miss penalties are charged to the simulated time per cycles_per_tick. */
+	size_t cycles_per_tick;
+	size_t cycles;
+} simos_cache_t;
+
+/** Create a hierarchy without levels. */
+simos_cache_t *simos_cache_create();
+void simos_cache_destroy(simos_cache_t *cache);
+/**
+ * Add the next level (L1 first). Return false whether it is full, sets or
+ * line_size is 0, or ways is not a power of two up to 64.
+ */
+int simos_cache_add_level(simos_cache_t *cache, size_t sets, size_t ways,
+		size_t line_size, int policy, size_t latency);
+/** Forget every line and statistic. */
+void simos_cache_flush(simos_cache_t *cache);
+/** Access an address. Return the miss penalty in cycles. */
+size_t simos_cache_access(simos_cache_t *cache, size_t address);
+/** Next address of the process' address stream. */
+size_t simos_cache_reference(simos_cache_t *cache, simos_process_t *proc);
+/** Run the accesses of a tick. Return the simulated time spent. */
+size_t simos_cache_tick(simos_cache_t *cache, simos_process_t *proc);
+
+
+
+/***********************************************************************
+ * disk declarations
+ **********************************************************************/
+#define SIMOS_DISK_FCFS 0
+/** Shortest seek time first. */
+#define SIMOS_DISK_SSTF 1
+/** Elevator, from one edge of the disk to the other. */
+#define SIMOS_DISK_SCAN 2
+/** Upwards only, back to the lowest request at the last one. */
+#define SIMOS_DISK_CLOOK 3
+/** C-LOOK, but a request waiting longer than `expire' goes first. */
+#define SIMOS_DISK_DEADLINE 4
+
+/** A pending request, ordered both by sector and by arrival. */
+typedef struct {
+	void *data;
+	size_t sector;
+	size_t count;
+	size_t submitted;
+	simos_rb_node_t by_sector;
+	simos_list_node_t by_arrival;
+} simos_disk_request_t;
+
+typedef struct {
+	size_t cylinders;
+	size_t heads;
+	size_t sectors_per_track;
+
+	/**
+	 * Seeking d cylinders takes seek_settle + d * seek_full / cylinders,
+	 * then the sector comes after a part of a rotation and is read at
+	 * sectors_per_track per rotation.
+	 */
+	size_t seek_settle;
+	size_t seek_full;
+	size_t rotation;
+
+	int policy;
+	size_t expire;
+	/** % of the requests reading right after the process' last one. */
+	size_t locality;
+
+	/** Cylinder under the head and whether it goes up (SCAN). */
+	size_t cylinder;
+	int up;
+
+	simos_rb_tree_t *queue;
+	simos_list_t *fifo;
+
+	size_t requests;
+	size_t seek_distance;
+	size_t wait_time;
+	size_t service_time;
+} simos_disk_t;
+
+/** Create an idle disk with the head at cylinder 0. */
+simos_disk_t *simos_disk_create(size_t cylinders, size_t heads,
+		size_t sectors_per_track, int policy);
+void simos_disk_destroy(simos_disk_t *disk);
+/** Forget the statistics. */
+void simos_disk_reset(simos_disk_t *disk);
+/** Number of sectors. */
+size_t simos_disk_size(simos_disk_t *disk);
+/** Queue a request of `count' sectors from `sector' on, O(log n). */
+void simos_disk_add(simos_disk_t *disk, void *data, size_t sector,
+		size_t count, size_t now);
+/**
+ * Take the next request by the policy, O(log n), and move the head to
+ * it. Return its data, the time to serve it goes to service. NULL if
+ * no request is pending.
+ */
+void *simos_disk_next(simos_disk_t *disk, size_t now, size_t *service);
+
+
+
+/***********************************************************************
+ * file system declarations
+ **********************************************************************/
+#define SIMOS_FS_MAGIC 0x464d4953U
+#define SIMOS_FS_BLOCK 4096
+/** Disk sectors of a block. */
+#define SIMOS_FS_SECTORS (SIMOS_FS_BLOCK / 512)
+#define SIMOS_FS_EXTENTS 12
+/** Buffer cache replacement. */
+#define SIMOS_FS_LRU 0
+#define SIMOS_FS_CLOCK 1
+/** Dirty buffers written back together, in block order. */
+#define SIMOS_FS_BATCH 16
+
+/**
+ * The image: a super block, the bit map of the used blocks, the inodes
+ * and the data blocks. Files are made of up to SIMOS_FS_EXTENTS runs of
+ * contiguous blocks.
+ */
+typedef struct {
+	unsigned int magic;
+	unsigned int nblocks;
+	unsigned int ninodes;
+	unsigned int bitmap;
+	unsigned int inodes;
+	unsigned int data;
+} simos_fs_super_t;
+
+typedef struct {
+	unsigned int start;
+	unsigned int len;
+} simos_fs_extent_t;
+
+typedef struct {
+	unsigned int used;
+	unsigned int nextents;
+	unsigned long long size;
+	simos_fs_extent_t extent[SIMOS_FS_EXTENTS];
+} simos_fs_inode_t;
+
+/** A block in the buffer cache. */
+typedef struct simos_fs_buf {
+	size_t block;
+	int valid;
+	int dirty;
+	/** CLOCK: used since the hand last passed. */
+	int ref;
+	unsigned char *data;
+	struct simos_fs_buf *hash_next;
+	/** LRU order, most recent at the tail, and dirty buffers by age. */
+	simos_list_node_t lru;
+	simos_list_node_t dirty_link;
+} simos_fs_buf_t;
+
+typedef struct {
+	int fd;
+	unsigned char *image;
+	size_t image_size;
+	/** Metadata is used right from the image, data goes by the cache. */
+	simos_fs_super_t *super;
+	unsigned char *bitmap;
+	simos_fs_inode_t *inodes;
+
+	int policy;
+	size_t nbuf;
+	simos_fs_buf_t *buf;
+	simos_fs_buf_t **hash;
+	size_t hash_mask;
+	simos_list_t *lru;
+	simos_list_t *dirty;
+	size_t hand;
+
+	/** Processes' file accesses: % of writes. */
+	size_t writes;
+
+	size_t hits;
+	size_t misses;
+	size_t writebacks;
+	size_t batches;
+	/** Block of the last device access. */
+	size_t last_io;
+} simos_fs_t;
+
+/**
+ * Format a new image of nblocks at path, with room for ninodes files and
+ * nbuf buffers in the cache. NULL on failure.
+ */
+simos_fs_t *simos_fs_create(const char *path, size_t nblocks,
+		size_t ninodes, size_t nbuf, int policy);
+/** Mount the image at path. NULL on failure. */
+simos_fs_t *simos_fs_open(const char *path, size_t nbuf, int policy);
+/** Write back every dirty buffer and unmount. */
+void simos_fs_destroy(simos_fs_t *fs);
+/** Write back every dirty buffer. Return how many. */
+size_t simos_fs_sync(simos_fs_t *fs);
+/** Create an empty file. Return its inode, -1 if none is free. */
+int simos_fs_creat(simos_fs_t *fs);
+/** Remove the file and free its blocks. Return true or false. */
+int simos_fs_unlink(simos_fs_t *fs, int ino);
+/** Size of the file, -1 if it does not exist. */
+size_t simos_fs_size(simos_fs_t *fs, int ino);
+/**
+ * Read len bytes of the file from offset on. Return the bytes read, less
+ * at the end of the file, -1 if it does not exist.
+ */
+size_t simos_fs_read(simos_fs_t *fs, int ino, size_t offset, void *buf,
+		size_t len);
+/**
+ * Write len bytes to the file from offset on, growing it as needed.
+ * Return the bytes written, less when the disk or the extents run out,
+ * -1 if it does not exist.
+ */
+size_t simos_fs_write(simos_fs_t *fs, int ino, size_t offset,
+		const void *buf, size_t len);
+
+
+
+/***********************************************************************
+ * I/O declarations
+ **********************************************************************/
+
+/** A device serves one request at a time, the others wait in order. */
+typedef struct {
+	simos_list_t *queue;
+	/** Request in service and when it is over. */
+	simos_list_node_t *busy;
+	size_t done_at;
+	/** Requests are timed and ordered by the disk, if any. */
+	simos_disk_t *disk;
+
+	size_t requests;
+	size_t busy_time;
+} simos_device_t;
+
+struct simos_io {
+	int ndev;
+	simos_device_t *dev;
+	/** Completions, by time, of the requests in service. */
+	simos_heap_t *events;
+	/** Requests in service or waiting. */
+	size_t pending;
+	/**
+	 * With a file system, an I/O burst reads or writes io_burst blocks
+	 * of the process' file and only what the buffer cache misses goes
+	 * to the device.
+	 */
+	simos_fs_t *fs;
+};
+
+/** Create `ndev' idle devices. */
+simos_io_t *simos_io_create(int ndev);
+/** Free the devices, with their disks and the file system, if any. */
+void simos_io_destroy(simos_io_t *io);
+/** Forget the statistics. */
+void simos_io_reset(simos_io_t *io);
+/**
+ * The process in the node starts an I/O burst at `now'. Return true
+ * whether it blocks, false if the buffer cache did it all.
+ */
+int simos_io_submit(simos_io_t *io, simos_list_node_t *node, size_t now);
+/** A node whose I/O is over by `now', NULL if none. */
+simos_list_node_t *simos_io_complete(simos_io_t *io, size_t now);
+/** Time of the next completion, -1 if no request is pending. */
+size_t simos_io_next(simos_io_t *io);
+
+
+
+/***********************************************************************
+ * timer declarations
+ **********************************************************************/
+/** A wheel has 64 slots, each level 64 times coarser than the one below. */
+#define SIMOS_WHEEL_BITS 6
+#define SIMOS_WHEEL_SIZE (1 << SIMOS_WHEEL_BITS)
+#define SIMOS_WHEEL_LEVELS 8
+
+/** A timer lives in the caller's memory, a wheel only links it. */
+typedef struct simos_timer {
+	size_t expires;
+	void (* fn)(void *arg, size_t now);
+	void *arg;
+
+	struct simos_timer *next;
+	struct simos_timer *prev;
+	/**
+	 * Slot holding the timer, -1 if it is not pending. Level
+	 * SIMOS_WHEEL_LEVELS: about to fire.
+	 */
+	int level;
+	int slot;
+} simos_timer_t;
+
+/**
+ * Hierarchical timing wheel: a timer due in less than 64^(l+1) units of
+ * time waits in level l and goes down a level whenever its slot comes,
+ * until it fires from level 0.
+ */
+struct simos_wheel {
+	simos_timer_t *slot[SIMOS_WHEEL_LEVELS][SIMOS_WHEEL_SIZE];
+	unsigned long nonempty[SIMOS_WHEEL_LEVELS];
+	/** Timers of the slot being fired. */
+	simos_timer_t *expired;
+	/** First time not processed yet. */
+	size_t next;
+	/** Nothing happens before this time. */
+	size_t next_event;
+	size_t count;
+};
+
+/** Create an empty wheel whose time is `now'. */
+simos_wheel_t *simos_wheel_new(size_t now);
+/** Drop every pending timer and start the wheel over at `now'. */
+void simos_wheel_reset(simos_wheel_t *w, size_t now);
+/** Free the wheel, not the timers. */
+void simos_wheel_free(simos_wheel_t *w);
+/** Prepare a timer calling fn(arg, now) when it expires. */
+void simos_timer_init(simos_timer_t *t, void (* fn)(void *arg, size_t now),
+		void *arg);
+/** Add the timer, or move it whether pending. O(1). */
+void simos_wheel_add(simos_wheel_t *w, simos_timer_t *t, size_t expires);
+/** Remove a pending timer, O(1). Return true or false. */
+int simos_wheel_del(simos_wheel_t *w, simos_timer_t *t);
+/** Time of the next slot holding timers, -1 if none. */
+size_t simos_wheel_next(simos_wheel_t *w);
+/** Fire every timer expired by `now'. Return how many fired. */
+size_t simos_wheel_advance(simos_wheel_t *w, size_t now);
+
+
+
+/***********************************************************************
+ * sync declarations
+ **********************************************************************/
+#define SIMOS_SYNC_MUTEX 0
+#define SIMOS_SYNC_SEM 1
+#define SIMOS_SYNC_COND 2
+
+/**
+ * A mutex, counting semaphore or condition variable. Blocked processes
+ * wait in order, their nodes in `waiters'.
+ */
+struct simos_sync {
+	int type;
+	/** Semaphore value. */
+	int count;
+	/** Mutex: holder, next mutex held by it, priority inheritance. */
+	simos_process_t *owner;
+	simos_sync_t *held_next;
+	int inherit;
+	/** Condition variable: mutex of its waiters. */
+	simos_sync_t *mutex;
+	simos_list_t *waiters;
+
+	size_t acquisitions;
+	size_t contentions;
+	size_t boosts;
+	size_t deadlocks;
+};
+
+simos_sync_t *simos_mutex_new(int inherit);
+simos_sync_t *simos_sem_new(int count);
+simos_sync_t *simos_cond_new();
+void simos_sync_destroy(simos_sync_t *s);
+/**
+ * Take the mutex for the process in the node. Return 1 whether taken, 0
+ * if the node was queued to wait, -1 if waiting would close a cycle of
+ * the wait-for graph (a deadlock): the node is not queued then.
+ */
+int simos_mutex_lock(simos_sync_t *m, simos_list_node_t *node, size_t now);
+/**
+ * Release the mutex. It goes right to the first waiter, whose node is
+ * returned to be made ready again, NULL if none.
+ */
+simos_list_node_t *simos_mutex_unlock(simos_sync_t *m, size_t now);
+/** Return 1 whether the semaphore was taken, 0 if the node was queued. */
+int simos_sem_wait(simos_sync_t *s, simos_list_node_t *node, size_t now);
+/** Release the semaphore. Return the node of the woken process or NULL. */
+simos_list_node_t *simos_sem_post(simos_sync_t *s, size_t now);
+/**
+ * Release the mutex and wait on the condition variable. Return the node
+ * of the process the mutex went to, NULL if none.
+ */
+simos_list_node_t *simos_cond_wait(simos_sync_t *c, simos_sync_t *m,
+		simos_list_node_t *node, size_t now);
+/**
+ * Wake the first waiter. It takes its mutex back, or waits for it. Return
+ * its node whether it can run, NULL otherwise.
+ */
+simos_list_node_t *simos_cond_signal(simos_sync_t *c, size_t now);
+
+
+
+/***********************************************************************
+ * ipc declarations
+ **********************************************************************/
+#define SIMOS_IPC_PIPE 0
+#define SIMOS_IPC_MQ 1
+
+/**
+ * A pipe (a stream of bytes) or a message queue, bounded, kept in a ring
+ * buffer. A process which can not send or receive all it asked waits in
+ * order, its node in `senders' or `receivers', with the transfer left in
+ * ipc_data/ipc_left.
+ */
+struct simos_chan {
+	int type;
+	char *buf;
+	/** Bytes of a pipe, messages of a queue. */
+	size_t cap;
+	/** Queue: size of a slot, the largest message, and their sizes. */
+	size_t msg_max;
+	size_t *sizes;
+	size_t head;
+	size_t len;
+	/** Open ends: no writers is the end of file, no readers an error. */
+	int readers;
+	int writers;
+	simos_list_t *senders;
+	simos_list_t *receivers;
+
+	size_t bytes;
+	size_t messages;
+	size_t send_waits;
+	size_t recv_waits;
+};
+
+simos_chan_t *simos_pipe_new(size_t cap);
+simos_chan_t *simos_mq_new(size_t cap, size_t msg_max);
+/** Free the channel, its waiters are left alone. */
+void simos_chan_destroy(simos_chan_t *c);
+/**
+ * Send n bytes (data may be NULL). Return 1 whether all was sent, 0 if
+ * the node was queued to wait, -1 if nobody reads or the message is too
+ * large.
+ */
+int simos_chan_send(simos_chan_t *c, simos_list_node_t *node,
+		const void *data, size_t n, size_t now);
+/**
+ * Receive up to n bytes, a pipe waits for all of them, a queue for a
+ * message. Return 1 whether done, ipc_done bytes received (0: end of
+ * file), 0 if the node was queued to wait.
+ */
+int simos_chan_recv(simos_chan_t *c, simos_list_node_t *node,
+		void *data, size_t n, size_t now);
+/** Close an end, the writing one whether `writer'. */
+void simos_chan_close(simos_chan_t *c, int writer);
+/**
+ * Carry on the transfers of the waiters. Return the node of a process
+ * done waiting, to be made ready again, NULL if none: call it until NULL
+ * after every send, receive or close.
+ */
+simos_list_node_t *simos_chan_wake(simos_chan_t *c, size_t now);
+
+
+/***********************************************************************
+ * bank declarations
+ **********************************************************************/
+
+/**
+ * Resources of nres types handed out by the banker's algorithm. Max,
+ * Allocation and Need (Max - Allocation) hold a row of each process and
+ * are stored column-major, one column of `cap' rows for each type, so a
+ * type is compared for all the processes at once. Counts fit in an int.
+ */
+typedef struct {
+	int nres;
+	int *total;
+	int *available;
+
+	int cap;
+	int *max;
+	int *alloc;
+	int *need;
+	/** Rows in use, and the rows left by the processes (a stack). */
+	int *used;
+	int *free;
+	int nfree;
+	int rows;
+
+	/** A process asks for more every `period' units of time of CPU. */
+	size_t period;
+	/** Scratch room of the safety check and of the requests. */
+	int *work;
+	int *ok;
+	int *left;
+	int *req;
+
+	size_t requests;
+	size_t granted;
+	size_t unsafe;
+	size_t unavailable;
+	/** Requests granted without a full safety check. */
+	size_t shortcuts;
+} simos_bank_t;
+
+/** Create a banker owning total[r] units of each of the nres types. */
+simos_bank_t *simos_bank_create(int nres, const int *total);
+void simos_bank_destroy(simos_bank_t *bank);
+/**
+ * Admit the process claiming at most max[r] units of each type, NULL to
+ * draw the claims from the process' seed. Return false whether a claim
+ * exceeds what the banker owns.
+ */
+int simos_bank_admit(simos_bank_t *bank, simos_process_t *proc,
+		const int *max);
+/** The process leaves, giving back whatever it holds. */
+void simos_bank_leave(simos_bank_t *bank, simos_process_t *proc);
+/** Whether every process can still finish, in some order. */
+int simos_bank_safe(simos_bank_t *bank);
+/**
+ * Ask for req[r] more units of each type. Return 1 whether granted, 0 if
+ * the process must wait (not available or unsafe), -1 if the request
+ * exceeds its claim.
+ */
+int simos_bank_request(simos_bank_t *bank, simos_process_t *proc,
+		const int *req);
+/** Give back req[r] units of each type, NULL: everything held. */
+void simos_bank_release(simos_bank_t *bank, simos_process_t *proc,
+		const int *req);
+/** Take back every allocation and forget the statistics. */
+void simos_bank_reset(simos_bank_t *bank);
+/** The running process asks for more, or gives all back once served. */
+void simos_bank_tick(simos_bank_t *bank, simos_process_t *proc);
+
 
 /***********************************************************************
  * simos declarations
@@ -258,6 +1870,23 @@ void simos_memory_free(simos_memory_t *mem, size_t pointer, size_t length);
 typedef struct {
 	simos_scheduler_t *sched;
 	simos_memory_t *mem;
+	/** Processes waiting for memory to be admitted. */
+	simos_list_t *pending;
+	simos_paging_t *paging;
+	simos_cache_t *cache;
+	simos_io_t *io;
+	/** Timers of the simulation, run as the time goes by. */
+	simos_wheel_t *timers;
+	/** Resources handed out avoiding deadlocks, NULL if none. */
+	simos_bank_t *bank;
+	/** Processes swapped out when the memory is short, NULL if off. */
+	simos_swap_t *swap;
+	/** Memory nodes and their distances, NULL if the memory is flat. */
+	simos_numa_t *numa;
+	/** Root of the process groups, NULL if none. */
+	simos_group_t *groups;
+	/** Frequency scaling of the CPUs, NULL: always at full speed. */
+	simos_dvfs_t *dvfs;
 } simos_t;
 
 /** Create a new simulation of a system with the memory size as specified. */
@@ -265,10 +1894,30 @@ simos_t *simos_new(size_t memory_size);
 /** Add a process to the scheduler. */
 int simos_add_process(simos_t *simos, simos_process_t *proc,
 		simos_memory_conf_t *mconf);
+/**
+ * Fork the parent into a new process `pid', ready to run. With paging its
+ * pages are shared and copied on write, otherwise it gets a memory of
+ * its own. Return the child.
+ */
+simos_process_t *simos_fork(simos_t *simos, simos_process_t *parent, int pid,
+		simos_memory_conf_t *mconf);
+/** Try to admit the pending processes. Return how many were admitted. */
+int simos_admit_pending(simos_t *simos, size_t now);
+/**
+ * Timer firing at time `expires' of the current execution. The ones
+ * still pending when an execution starts are dropped.
+ */
+void simos_timer_add(simos_t *simos, simos_timer_t *t, size_t expires);
+/** Cancel a pending timer. Return true or false. */
+int simos_timer_cancel(simos_t *simos, simos_timer_t *t);
 /** Execute the simulation... */
 void simos_execute(simos_t *simos, simos_scheduler_conf_t *conf,
 		int algorithm);
-/** After execution, the memory must be freed. */
+/**
+ * After execution, the memory must be freed, and whatever the simulation
+ * was given: paging, cache, devices, bank, swap, NUMA, groups, DVFS,
+ * compaction, and the processes still pending.
+ */
 void simos_free(simos_t *simos);
 
 
@@ -0,0 +1,375 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 ljr-ifsp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "simos.h"
+
+/** Column of the resource type `r' in one of the matrices. */
+#define SIMOS_BANK_COL(bank, m, r) ((bank)->m + (size_t) (r) * (bank)->cap)
+
+simos_bank_t *simos_bank_create(int nres, const int *total)
+{
+	simos_bank_t *bank = malloc(sizeof(simos_bank_t));
+
+	bank->nres = nres;
+	bank->total = malloc(nres * sizeof(int));
+	bank->available = malloc(nres * sizeof(int));
+	memcpy(bank->total, total, nres * sizeof(int));
+	memcpy(bank->available, total, nres * sizeof(int));
+
+	bank->cap = 0;
+	bank->max = NULL;
+	bank->alloc = NULL;
+	bank->need = NULL;
+	bank->used = NULL;
+	bank->free = NULL;
+	bank->nfree = 0;
+	bank->rows = 0;
+
+	bank->period = 10;
+	bank->work = malloc(nres * sizeof(int));
+	bank->ok = NULL;
+	bank->left = NULL;
+	bank->req = malloc(nres * sizeof(int));
+
+	bank->requests = 0;
+	bank->granted = 0;
+	bank->unsafe = 0;
+	bank->unavailable = 0;
+	bank->shortcuts = 0;
+
+	return bank;
+}
+
+void simos_bank_destroy(simos_bank_t *bank)
+{
+	free(bank->total);
+	free(bank->available);
+	free(bank->max);
+	free(bank->alloc);
+	free(bank->need);
+	free(bank->used);
+	free(bank->free);
+	free(bank->work);
+	free(bank->ok);
+	free(bank->left);
+	free(bank->req);
+	free(bank);
+}
+
+/** Copy the columns of the matrix into columns of `cap' rows. */
+static int *simos_bank_relayout(simos_bank_t *bank, int *m, int cap)
+{
+	int *n = calloc((size_t) bank->nres * cap, sizeof(int));
+	int r;
+
+	for (r = 0; m && r < bank->nres; r++) {
+		memcpy(n + (size_t) r * cap, m + (size_t) r * bank->cap,
+				bank->cap * sizeof(int));
+	}
+	free(m);
+
+	return n;
+}
+
+/** Room for twice the rows, kept a multiple of four. */
+static void simos_bank_grow(simos_bank_t *bank)
+{
+	int cap = bank->cap ? 2 * bank->cap : 64;
+
+	bank->max = simos_bank_relayout(bank, bank->max, cap);
+	bank->alloc = simos_bank_relayout(bank, bank->alloc, cap);
+	bank->need = simos_bank_relayout(bank, bank->need, cap);
+
+	bank->used = realloc(bank->used, cap * sizeof(int));
+	memset(bank->used + bank->cap, 0, (cap - bank->cap) * sizeof(int));
+	bank->free = realloc(bank->free, cap * sizeof(int));
+	bank->ok = realloc(bank->ok, cap * sizeof(int));
+	bank->left = realloc(bank->left, cap * sizeof(int));
+	bank->cap = cap;
+}
+
+int simos_bank_admit(simos_bank_t *bank, simos_process_t *proc,
+		const int *max)
+{
+	int r, row, claim;
+
+	for (r = 0; max && r < bank->nres; r++) {
+		if (max[r] < 0 || max[r] > bank->total[r]) {
+			return 0;
+		}
+	}
+
+	if (proc->bank_row >= 0) {
+		simos_bank_leave(bank, proc);
+	}
+
+	if (bank->nfree) {
+		row = bank->free[--bank->nfree];
+	} else {
+		if (bank->rows == bank->cap) {
+			simos_bank_grow(bank);
+		}
+		row = bank->rows++;
+	}
+
+	/* a newcomer holding nothing can always finish after the others,
+	 * admitting it keeps the state safe */
+	for (r = 0; r < bank->nres; r++) {
+		claim = max ? max[r]
+			: (int) (rand_r(&proc->seed) % (bank->total[r] / 2 + 1));
+		SIMOS_BANK_COL(bank, max, r)[row] = claim;
+		SIMOS_BANK_COL(bank, alloc, r)[row] = 0;
+		SIMOS_BANK_COL(bank, need, r)[row] = claim;
+	}
+	bank->used[row] = 1;
+	proc->bank_row = row;
+
+	return 1;
+}
+
+void simos_bank_leave(simos_bank_t *bank, simos_process_t *proc)
+{
+	int r, row = proc->bank_row;
+
+	if (row < 0) {
+		return;
+	}
+
+	simos_bank_release(bank, proc, NULL);
+	for (r = 0; r < bank->nres; r++) {
+		SIMOS_BANK_COL(bank, max, r)[row] = 0;
+		SIMOS_BANK_COL(bank, need, r)[row] = 0;
+	}
+	bank->used[row] = 0;
+	bank->free[bank->nfree++] = row;
+	proc->bank_row = -1;
+}
+
+/**
+ * Keep ok[i] (0 or -1) only where need[i] <= work. With SSE2 four rows
+ * are compared in a single instruction.
+ */
+static void simos_bank_fits(const int *need, int work, int *ok, int n)
+{
+	int i = 0;
+#ifdef __SSE2__
+	__m128i w = _mm_set1_epi32(work);
+	__m128i gt;
+
+	for (; i + 4 <= n; i += 4) {
+		gt = _mm_cmpgt_epi32(_mm_loadu_si128((const __m128i *) (need + i)),
+				w);
+		_mm_storeu_si128((__m128i *) (ok + i), _mm_andnot_si128(gt,
+					_mm_loadu_si128((const __m128i *) (ok + i))));
+	}
+#endif
+	for (; i < n; i++) {
+		if (need[i] > work) {
+			ok[i] = 0;
+		}
+	}
+}
+
+/** Sum of alloc[i] where ok[i] is -1. */
+static int simos_bank_sum(const int *alloc, const int *ok, int n)
+{
+	int i = 0, sum = 0;
+#ifdef __SSE2__
+	__m128i acc = _mm_setzero_si128();
+	int lane[4];
+
+	for (; i + 4 <= n; i += 4) {
+		acc = _mm_add_epi32(acc, _mm_and_si128(
+					_mm_loadu_si128((const __m128i *) (alloc + i)),
+					_mm_loadu_si128((const __m128i *) (ok + i))));
+	}
+	_mm_storeu_si128((__m128i *) lane, acc);
+	sum = lane[0] + lane[1] + lane[2] + lane[3];
+#endif
+	for (; i < n; i++) {
+		sum += alloc[i] & ok[i];
+	}
+
+	return sum;
+}
+
+/**
+ * Every pass finishes at once all the processes whose need fits in what
+ * is free, and takes their allocation back. Finishing a process never
+ * hurts the others, so the order within a pass does not matter.
+ */
+int simos_bank_safe(simos_bank_t *bank)
+{
+	int i, r, done, left = 0;
+
+	memcpy(bank->work, bank->available, bank->nres * sizeof(int));
+	for (i = 0; i < bank->rows; i++) {
+		bank->left[i] = bank->used[i] ? -1 : 0;
+		left += bank->used[i];
+	}
+
+	while (left) {
+		memcpy(bank->ok, bank->left, bank->rows * sizeof(int));
+		for (r = 0; r < bank->nres; r++) {
+			simos_bank_fits(SIMOS_BANK_COL(bank, need, r), bank->work[r],
+					bank->ok, bank->rows);
+		}
+
+		for (i = 0, done = 0; i < bank->rows; i++) {
+			if (bank->ok[i]) {
+				bank->left[i] = 0;
+				done++;
+			}
+		}
+		if (done == 0) {
+			return 0;
+		}
+		left -= done;
+
+		for (r = 0; left && r < bank->nres; r++) {
+			bank->work[r] += simos_bank_sum(SIMOS_BANK_COL(bank, alloc, r),
+					bank->ok, bank->rows);
+		}
+	}
+
+	return 1;
+}
+
+/** Move `n' units of the type `r' from the free ones to the row. */
+static void simos_bank_move(simos_bank_t *bank, int row, int r, int n)
+{
+	bank->available[r] -= n;
+	SIMOS_BANK_COL(bank, alloc, r)[row] += n;
+	SIMOS_BANK_COL(bank, need, r)[row] -= n;
+}
+
+int simos_bank_request(simos_bank_t *bank, simos_process_t *proc,
+		const int *req)
+{
+	int r, row = proc->bank_row;
+
+	bank->requests++;
+
+	for (r = 0; r < bank->nres; r++) {
+		if (req[r] > SIMOS_BANK_COL(bank, need, r)[row]) {
+			return -1;
+		}
+	}
+
+	for (r = 0; r < bank->nres; r++) {
+		if (req[r] > bank->available[r]) {
+			bank->unavailable++;
+			return 0;
+		}
+	}
+
+	for (r = 0; r < bank->nres; r++) {
+		simos_bank_move(bank, row, r, req[r]);
+	}
+
+	/* the state was safe: whether the process can still finish right
+	 * away with what is left, it gives back all it got and the rest
+	 * finish as before, no need to look at the others */
+	for (r = 0; r < bank->nres
+			&& SIMOS_BANK_COL(bank, need, r)[row] <= bank->available[r];
+			r++);
+	if (r == bank->nres) {
+		bank->shortcuts++;
+	} else if (! simos_bank_safe(bank)) {
+		for (r = 0; r < bank->nres; r++) {
+			simos_bank_move(bank, row, r, -req[r]);
+		}
+		bank->unsafe++;
+		return 0;
+	}
+
+	bank->granted++;
+	return 1;
+}
+
+void simos_bank_release(simos_bank_t *bank, simos_process_t *proc,
+		const int *req)
+{
+	int r, n, row = proc->bank_row;
+
+	if (row < 0) {
+		return;
+	}
+
+	for (r = 0; r < bank->nres; r++) {
+		n = SIMOS_BANK_COL(bank, alloc, r)[row];
+		if (req && req[r] < n) {
+			n = req[r];
+		}
+		simos_bank_move(bank, row, r, -n);
+	}
+}
+
+void simos_bank_reset(simos_bank_t *bank)
+{
+	int r;
+
+	memcpy(bank->available, bank->total, bank->nres * sizeof(int));
+	for (r = 0; r < bank->nres; r++) {
+		memcpy(SIMOS_BANK_COL(bank, need, r), SIMOS_BANK_COL(bank, max, r),
+				bank->rows * sizeof(int));
+		memset(SIMOS_BANK_COL(bank, alloc, r), 0, bank->rows * sizeof(int));
+	}
+
+	bank->requests = 0;
+	bank->granted = 0;
+	bank->unsafe = 0;
+	bank->unavailable = 0;
+	bank->shortcuts = 0;
+}
+
+void simos_bank_tick(simos_bank_t *bank, simos_process_t *proc)
+{
+	int k, r = 0, need, row = proc->bank_row;
+
+	if (row < 0 || bank->period == 0
+			|| proc->running_time % bank->period) {
+		return;
+	}
+
+	k = rand_r(&proc->seed) % bank->nres;
+	for (need = 0; need == 0 && k < 2 * bank->nres; k++) {
+		r = k % bank->nres;
+		need = SIMOS_BANK_COL(bank, need, r)[row];
+	}
+
+	if (need == 0) {
+		/* all it claimed was granted: done with them for now */
+		simos_bank_release(bank, proc, NULL);
+		return;
+	}
+
+	memset(bank->req, 0, bank->nres * sizeof(int));
+	bank->req[r] = 1 + rand_r(&proc->seed) % need;
+	simos_bank_request(bank, proc, bank->req);
+}
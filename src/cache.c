@@ -0,0 +1,291 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 ljr-ifsp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "simos.h"
+
+/** Create a hierarchy without levels. */
+simos_cache_t *simos_cache_create()
+{
+	simos_cache_t *cache = malloc(sizeof(simos_cache_t));
+
+	cache->nlevels = 0;
+	cache->memory_latency = 200;
+	cache->accesses_per_tick = 100;
+	cache->locality = 90;
+	cache->bytes_per_cell = 1024;
+	cache->cycles_per_tick = 10000;
+	cache->cycles = 0;
+
+	return cache;
+}
+
+void simos_cache_destroy(simos_cache_t *cache)
+{
+	int i;
+
+	for (i = 0; i < cache->nlevels; i++) {
+		free(cache->level[i].tags);
+		free(cache->level[i].stamp);
+		free(cache->level[i].tree);
+	}
+	free(cache);
+}
+
+/**
+ * Add the next level (L1 first). Return false whether it is full or the
+ * geometry is invalid: the tree-PLRU of a set is a single unsigned long,
+ * so the ways are a power of two up to its bits.
+ */
+int simos_cache_add_level(simos_cache_t *cache, size_t sets, size_t ways,
+		size_t line_size, int policy, size_t latency)
+{
+	simos_cache_level_t *l;
+
+	if (cache->nlevels == SIMOS_CACHE_LEVELS) {
+		return 0;
+	}
+	if (sets == 0 || line_size == 0 || ways == 0
+			|| ways > 8 * sizeof(unsigned long) || (ways & (ways - 1))) {
+		return 0;
+	}
+
+	l = &cache->level[cache->nlevels++];
+	l->sets = sets;
+	l->ways = ways;
+	l->line_size = line_size;
+	l->policy = policy;
+	l->latency = latency;
+	l->tags = malloc(sets * ways * sizeof(unsigned int));
+	l->stamp = calloc(sets * ways, sizeof(unsigned int));
+	l->tree = calloc(sets, sizeof(unsigned long));
+	l->clock = 0;
+	memset(l->tags, 0xff, sets * ways * sizeof(unsigned int));
+	l->hits = 0;
+	l->misses = 0;
+
+	return 1;
+}
+
+/** Forget every line and statistic. */
+void simos_cache_flush(simos_cache_t *cache)
+{
+	simos_cache_level_t *l;
+	int i;
+
+	for (i = 0; i < cache->nlevels; i++) {
+		l = &cache->level[i];
+		memset(l->tags, 0xff, l->sets * l->ways * sizeof(unsigned int));
+		memset(l->stamp, 0, l->sets * l->ways * sizeof(unsigned int));
+		memset(l->tree, 0, l->sets * sizeof(unsigned long));
+		l->clock = 0;
+		l->hits = 0;
+		l->misses = 0;
+	}
+	cache->cycles = 0;
+}
+
+/**
+ * Way of the set holding the tag, or -1. With SSE2 four ways are compared
+ * in a single instruction.
+ */
+static int simos_cache_find(const unsigned int *tags, size_t ways,
+		unsigned int tag)
+{
+	size_t w = 0;
+#ifdef __SSE2__
+	__m128i key = _mm_set1_epi32((int) tag);
+	__m128i v;
+	int mask;
+
+	for (; w + 4 <= ways; w += 4) {
+		v = _mm_loadu_si128((const __m128i *) (tags + w));
+		mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v, key)));
+		if (mask) {
+			return w + __builtin_ctz(mask);
+		}
+	}
+#endif
+	for (; w < ways; w++) {
+		if (tags[w] == tag) {
+			return w;
+		}
+	}
+
+	return -1;
+}
+
+/** Mark the way as the most recently used of the set. */
+static void simos_cache_touch(simos_cache_level_t *l, size_t set, size_t way)
+{
+	unsigned long *tree = &l->tree[set];
+	size_t node = 1;
+	size_t half;
+
+	if (l->policy == SIMOS_CACHE_LRU) {
+		l->stamp[set * l->ways + way] = ++l->clock;
+		return;
+	}
+
+	/* every node on the path points away from the way */
+	for (half = l->ways / 2; half; half /= 2) {
+		if (way & half) {
+			*tree &= ~(1UL << node);
+			node = 2 * node + 1;
+		} else {
+			*tree |= 1UL << node;
+			node = 2 * node;
+		}
+	}
+}
+
+/** Way to be replaced in the set. */
+static size_t simos_cache_victim(simos_cache_level_t *l, size_t set)
+{
+	unsigned int *tags = &l->tags[set * l->ways];
+	unsigned int *stamp = &l->stamp[set * l->ways];
+	size_t node = 1;
+	size_t w, victim;
+	int empty;
+
+	empty = simos_cache_find(tags, l->ways, SIMOS_CACHE_INVALID);
+	if (empty >= 0) {
+		return empty;
+	}
+
+	if (l->policy == SIMOS_CACHE_LRU) {
+		victim = 0;
+		for (w = 1; w < l->ways; w++) {
+			if (stamp[w] < stamp[victim]) {
+				victim = w;
+			}
+		}
+		return victim;
+	}
+
+	while (node < l->ways) {
+		node = 2 * node + ((l->tree[set] >> node) & 1);
+	}
+
+	return node - l->ways;
+}
+
+/** Level hit by the access, nlevels whether it goes to the memory. */
+static int simos_cache_lookup(simos_cache_t *cache, size_t address)
+{
+	simos_cache_level_t *l;
+	size_t line, set, way;
+	unsigned int tag;
+	int i, hit;
+
+	for (i = 0; i < cache->nlevels; i++) {
+		l = &cache->level[i];
+		line = address / l->line_size;
+		set = line % l->sets;
+		tag = (unsigned int) (line / l->sets);
+
+		hit = simos_cache_find(&l->tags[set * l->ways], l->ways, tag);
+		if (hit >= 0) {
+			l->hits++;
+			simos_cache_touch(l, set, hit);
+			break;
+		}
+
+		l->misses++;
+		way = simos_cache_victim(l, set);
+		l->tags[set * l->ways + way] = tag;
+		simos_cache_touch(l, set, way);
+	}
+
+	return i;
+}
+
+static size_t simos_cache_penalty(simos_cache_t *cache, int level)
+{
+	if (level == 0) {
+		return 0; // L1 hits are part of the execution
+	} else if (level < cache->nlevels) {
+		return cache->level[level].latency;
+	}
+
+	return cache->memory_latency;
+}
+
+/** Access an address. Return the miss penalty in cycles. */
+size_t simos_cache_access(simos_cache_t *cache, size_t address)
+{
+	return simos_cache_penalty(cache, simos_cache_lookup(cache, address));
+}
+
+/**
+ * Next address of the process' address stream: mostly sequential words
+ * inside the process' memory, sometimes a jump anywhere in it.
+ */
+size_t simos_cache_reference(simos_cache_t *cache, simos_process_t *proc)
+{
+	size_t span = proc->required_memory * cache->bytes_per_cell;
+	size_t base;
+
+	if (proc->memory_pointer != (size_t) -1) {
+		base = proc->memory_pointer * cache->bytes_per_cell;
+	} else {
+		/* paging: a region of its own for each process */
+		base = (size_t) proc->pid * span;
+	}
+
+	if (span == 0) {
+		return base;
+	}
+
+	if ((size_t) (rand_r(&proc->seed) % 100) < cache->locality) {
+		proc->address = (proc->address + sizeof(size_t)) % span;
+	} else {
+		proc->address = rand_r(&proc->seed) % span;
+	}
+
+	return base + proc->address;
+}
+
+/** Run the accesses of a tick. Return the simulated time spent. */
+size_t simos_cache_tick(simos_cache_t *cache, simos_process_t *proc)
+{
+	size_t i, cost;
+	int level;
+
+	for (i = 0; i < cache->accesses_per_tick; i++) {
+		level = simos_cache_lookup(cache, simos_cache_reference(cache, proc));
+		if (level == cache->nlevels) {
+			proc->cache_misses++;
+		}
+		cache->cycles += simos_cache_penalty(cache, level);
+	}
+
+	cost = cache->cycles / cache->cycles_per_tick;
+	cache->cycles %= cache->cycles_per_tick;
+
+	return cost;
+}
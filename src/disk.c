@@ -0,0 +1,224 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 ljr-ifsp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <stdlib.h>
+#include <malloc.h>
+#include "simos.h"
+
+/** Create an idle disk with the head at cylinder 0. */
+simos_disk_t *simos_disk_create(size_t cylinders, size_t heads,
+		size_t sectors_per_track, int policy)
+{
+	simos_disk_t *disk = malloc(sizeof(simos_disk_t));
+
+	disk->cylinders = cylinders ? cylinders : 1;
+	disk->heads = heads ? heads : 1;
+	disk->sectors_per_track = sectors_per_track ? sectors_per_track : 1;
+	disk->seek_settle = 2;
+	disk->seek_full = 40;
+	disk->rotation = 12;
+	disk->policy = policy;
+	disk->expire = 500;
+	disk->locality = 50;
+
+	disk->cylinder = 0;
+	disk->up = 1;
+	disk->queue = simos_rb_new();
+	disk->fifo = simos_list_new();
+	simos_disk_reset(disk);
+
+	return disk;
+}
+
+void simos_disk_destroy(simos_disk_t *disk)
+{
+	simos_disk_request_t *req;
+	simos_list_node_t *n;
+
+	while ((n = simos_list_del_head(disk->fifo)) != NULL) {
+		req = n->data;
+		free(req);
+	}
+	free(disk->fifo);
+	free(disk->queue);
+	free(disk);
+}
+
+/** Forget the statistics. */
+void simos_disk_reset(simos_disk_t *disk)
+{
+	disk->requests = 0;
+	disk->seek_distance = 0;
+	disk->wait_time = 0;
+	disk->service_time = 0;
+}
+
+/** Number of sectors. */
+size_t simos_disk_size(simos_disk_t *disk)
+{
+	return disk->cylinders * disk->heads * disk->sectors_per_track;
+}
+
+/** Queue a request of `count' sectors from `sector' on, O(log n). */
+void simos_disk_add(simos_disk_t *disk, void *data, size_t sector,
+		size_t count, size_t now)
+{
+	simos_disk_request_t *req = malloc(sizeof(simos_disk_request_t));
+
+	req->data = data;
+	req->sector = sector % simos_disk_size(disk);
+	req->count = count;
+	req->submitted = now;
+
+	req->by_sector.data = req;
+	req->by_sector.key = req->sector;
+	simos_rb_insert(disk->queue, &req->by_sector);
+
+	req->by_arrival.data = req;
+	req->by_arrival.next = req->by_arrival.prev = NULL;
+	simos_list_add(disk->fifo, &req->by_arrival);
+}
+
+/** Cylinder of the sector. */
+static size_t simos_disk_cylinder(simos_disk_t *disk, size_t sector)
+{
+	return sector / (disk->heads * disk->sectors_per_track);
+}
+
+static size_t simos_disk_distance(size_t a, size_t b)
+{
+	return a > b ? a - b : b - a;
+}
+
+/** Cylinders from the head to the request in the node. */
+static size_t simos_disk_seek(simos_disk_t *disk, simos_rb_node_t *n)
+{
+	return simos_disk_distance(disk->cylinder,
+			simos_disk_cylinder(disk, n->key));
+}
+
+/**
+ * Next request by the policy. SCAN may have to reach the edge of the disk
+ * first, the cylinders travelled for that go to `travel'.
+ */
+static simos_disk_request_t *simos_disk_pick(simos_disk_t *disk, size_t now,
+		size_t *travel)
+{
+	simos_disk_request_t *req;
+	simos_rb_node_t *n, *prev;
+	size_t cylsize = disk->heads * disk->sectors_per_track;
+	size_t head = disk->cylinder * cylsize;
+
+	switch(disk->policy) {
+		case SIMOS_DISK_FCFS:
+			return disk->fifo->head->data;
+
+		case SIMOS_DISK_SSTF:
+			/* the nearest request on either side of the head */
+			n = simos_rb_lower_bound(disk->queue, head);
+			prev = n ? simos_rb_prev(n) : simos_rb_last(disk->queue);
+			if (n == NULL || (prev && simos_disk_seek(disk, prev)
+					< simos_disk_seek(disk, n))) {
+				n = prev;
+			}
+			return n->data;
+
+		case SIMOS_DISK_SCAN:
+			if (disk->up) {
+				n = simos_rb_lower_bound(disk->queue, head);
+				if (n == NULL) {
+					*travel = disk->cylinders - 1 - disk->cylinder;
+					disk->cylinder = disk->cylinders - 1;
+					disk->up = 0;
+					n = simos_rb_last(disk->queue);
+				}
+			} else {
+				/* the last request up to the end of this cylinder */
+				n = simos_rb_lower_bound(disk->queue, head + cylsize);
+				n = n ? simos_rb_prev(n) : simos_rb_last(disk->queue);
+				if (n == NULL) {
+					*travel = disk->cylinder;
+					disk->cylinder = 0;
+					disk->up = 1;
+					n = simos_rb_first(disk->queue);
+				}
+			}
+			return n->data;
+
+		case SIMOS_DISK_DEADLINE:
+			req = disk->fifo->head->data;
+			if (now - req->submitted >= disk->expire) {
+				return req;
+			}
+			/* falls through */
+
+		default: // C-LOOK
+			n = simos_rb_lower_bound(disk->queue, head);
+			if (n == NULL) {
+				n = simos_rb_first(disk->queue);
+			}
+			return n->data;
+	}
+}
+
+/** Take the next request by the policy and move the head to it. */
+void *simos_disk_next(simos_disk_t *disk, size_t now, size_t *service)
+{
+	simos_disk_request_t *req;
+	size_t travel = 0, cylinder, distance, seek, pos, target, rotation;
+	size_t spt = disk->sectors_per_track;
+	void *data;
+
+	if (simos_rb_empty(disk->queue)) {
+		return NULL;
+	}
+
+	req = simos_disk_pick(disk, now, &travel);
+	simos_rb_del(disk->queue, &req->by_sector);
+	simos_list_unlink(disk->fifo, &req->by_arrival);
+
+	cylinder = simos_disk_cylinder(disk, req->sector);
+	distance = travel + simos_disk_distance(disk->cylinder, cylinder);
+	seek = distance ? disk->seek_settle
+		+ distance * disk->seek_full / disk->cylinders : 0;
+
+	/* wait for the sector to come under the head */
+	pos = (now + seek) * spt / disk->rotation % spt;
+	target = req->sector % spt;
+	rotation = (target + spt - pos) % spt * disk->rotation / spt;
+
+	*service = seek + rotation + req->count * disk->rotation / spt;
+	if (*service == 0) {
+		*service = 1;
+	}
+
+	disk->cylinder = cylinder;
+	disk->requests++;
+	disk->seek_distance += distance;
+	disk->wait_time += now - req->submitted;
+	disk->service_time += *service;
+
+	data = req->data;
+	free(req);
+
+	return data;
+}
@@ -0,0 +1,153 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 ljr-ifsp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include "simos.h"
+
+/** 0.8 V at 800 MHz to 1.2 V at 2400 MHz, and 300 mW leaking. */
+static const simos_dvfs_level_t simos_dvfs_levels[] = {
+	{ 800, 818 },
+	{ 1200, 1284 },
+	{ 1800, 2123 },
+	{ 2400, 3800 },
+};
+
+simos_dvfs_t *simos_dvfs_create(int ncpus, const simos_dvfs_level_t *levels,
+		int nlevels, size_t idle_power, int governor)
+{
+	simos_dvfs_t *dvfs = malloc(sizeof(simos_dvfs_t));
+
+	if (levels == NULL) {
+		levels = simos_dvfs_levels;
+		nlevels = sizeof(simos_dvfs_levels) / sizeof(simos_dvfs_level_t);
+	}
+	if (nlevels > SIMOS_DVFS_MAX) {
+		nlevels = SIMOS_DVFS_MAX;
+	}
+	if (ncpus < 1) {
+		ncpus = 1;
+	} else if (ncpus > SIMOS_DVFS_CPUS) {
+		ncpus = SIMOS_DVFS_CPUS;
+	}
+
+	dvfs->nlevels = nlevels;
+	memcpy(dvfs->level, levels, nlevels * sizeof(simos_dvfs_level_t));
+	dvfs->idle_power = idle_power;
+	dvfs->ncpus = ncpus;
+	dvfs->governor = governor;
+	dvfs->sampling = 100;
+	dvfs->up_threshold = 80;
+	simos_dvfs_reset(dvfs, 0);
+
+	return dvfs;
+}
+
+void simos_dvfs_destroy(simos_dvfs_t *dvfs)
+{
+	free(dvfs);
+}
+
+/** A sampling period is over: pick the level for the load seen in it. */
+static void simos_dvfs_ondemand(simos_dvfs_t *dvfs, simos_dvfs_cpu_t *cpu,
+		size_t now)
+{
+	size_t elapsed = now - cpu->window_start, load, want;
+	int l;
+
+	if (elapsed < dvfs->sampling) {
+		return;
+	}
+
+	load = 100 * cpu->window_busy / elapsed;
+	if (load > dvfs->up_threshold) {
+		l = dvfs->nlevels - 1;
+	} else {
+		want = dvfs->level[cpu->level].freq * load / dvfs->up_threshold;
+		for (l = 0; l < dvfs->nlevels - 1 && dvfs->level[l].freq < want; l++)
+			;
+	}
+
+	if (l != cpu->level) {
+		cpu->level = l;
+		cpu->transitions++;
+	}
+	cpu->window_start = now;
+	cpu->window_busy = 0;
+}
+
+size_t simos_dvfs_tick(simos_dvfs_t *dvfs, simos_process_t *proc, size_t now)
+{
+	int node = proc->leader->numa_node;
+	simos_dvfs_cpu_t *cpu = &dvfs->cpu[node > 0 ? node % dvfs->ncpus : 0];
+	size_t top = dvfs->level[dvfs->nlevels - 1].freq, cost, energy;
+
+	if (dvfs->governor == SIMOS_DVFS_ONDEMAND) {
+		simos_dvfs_ondemand(dvfs, cpu, now);
+	}
+
+	/* the tick takes top / freq of the time it would at full speed */
+	cpu->pending += 1000 * top / dvfs->level[cpu->level].freq - 1000;
+	cost = cpu->pending / 1000;
+	cpu->pending %= 1000;
+
+	cpu->busy += 1 + cost;
+	cpu->time_at[cpu->level] += 1 + cost;
+	cpu->window_busy += 1 + cost;
+
+	energy = dvfs->level[cpu->level].power * (1 + cost);
+	cpu->energy += energy;
+	proc->energy += energy;
+
+	return cost;
+}
+
+size_t simos_dvfs_energy(simos_dvfs_t *dvfs, size_t now)
+{
+	size_t energy = 0;
+	int i;
+
+	for (i = 0; i < dvfs->ncpus; i++) {
+		energy += dvfs->cpu[i].energy;
+		if (now - dvfs->start > dvfs->cpu[i].busy) {
+			energy += dvfs->idle_power
+				* (now - dvfs->start - dvfs->cpu[i].busy);
+		}
+	}
+	return energy;
+}
+
+void simos_dvfs_reset(simos_dvfs_t *dvfs, size_t now)
+{
+	simos_dvfs_cpu_t *cpu;
+	int i;
+
+	dvfs->start = now;
+	for (i = 0; i < dvfs->ncpus; i++) {
+		cpu = &dvfs->cpu[i];
+		memset(cpu, 0, sizeof(simos_dvfs_cpu_t));
+		cpu->level = (dvfs->governor == SIMOS_DVFS_POWERSAVE)
+			? 0 : dvfs->nlevels - 1;
+		cpu->window_start = now;
+	}
+}
@@ -0,0 +1,565 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 ljr-ifsp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "simos.h"
+
+/*****************************************************************
+ * buffer cache
+ ****************************************************************/
+
+static size_t simos_fs_hash(simos_fs_t *fs, size_t block)
+{
+	return (block * 2654435761U) & fs->hash_mask;
+}
+
+/** Map the image and build an empty cache. */
+static simos_fs_t *simos_fs_mount(int fd, size_t size, size_t nbuf,
+		int policy)
+{
+	simos_fs_t *fs;
+	void *image;
+	size_t i;
+
+	image = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (image == MAP_FAILED) {
+		close(fd);
+		return NULL;
+	}
+
+	fs = malloc(sizeof(simos_fs_t));
+	fs->fd = fd;
+	fs->image = image;
+	fs->image_size = size;
+	fs->super = image;
+
+	fs->policy = policy;
+	fs->nbuf = nbuf ? nbuf : 1;
+	fs->buf = malloc(fs->nbuf * sizeof(simos_fs_buf_t));
+	fs->lru = simos_list_new();
+	fs->dirty = simos_list_new();
+	fs->hand = 0;
+	for (i = 0; i < fs->nbuf; i++) {
+		fs->buf[i].block = -1;
+		fs->buf[i].valid = 0;
+		fs->buf[i].dirty = 0;
+		fs->buf[i].ref = 0;
+		fs->buf[i].data = malloc(SIMOS_FS_BLOCK);
+		fs->buf[i].hash_next = NULL;
+		fs->buf[i].lru.data = &fs->buf[i];
+		fs->buf[i].lru.next = fs->buf[i].lru.prev = NULL;
+		fs->buf[i].dirty_link.data = &fs->buf[i];
+		fs->buf[i].dirty_link.next = fs->buf[i].dirty_link.prev = NULL;
+		simos_list_add(fs->lru, &fs->buf[i].lru);
+	}
+
+	for (fs->hash_mask = 1; fs->hash_mask < 2 * fs->nbuf; ) {
+		fs->hash_mask <<= 1;
+	}
+	fs->hash = calloc(fs->hash_mask, sizeof(simos_fs_buf_t *));
+	fs->hash_mask--;
+
+	fs->writes = 30;
+	fs->hits = 0;
+	fs->misses = 0;
+	fs->writebacks = 0;
+	fs->batches = 0;
+	fs->last_io = 0;
+
+	return fs;
+}
+
+/** Find the metadata in the image, after the super block is written. */
+static void simos_fs_layout(simos_fs_t *fs)
+{
+	fs->bitmap = fs->image + (size_t) fs->super->bitmap * SIMOS_FS_BLOCK;
+	fs->inodes = (simos_fs_inode_t *) (fs->image
+			+ (size_t) fs->super->inodes * SIMOS_FS_BLOCK);
+}
+
+static int simos_fs_used(simos_fs_t *fs, size_t block)
+{
+	return fs->bitmap[block / 8] & (1 << (block % 8));
+}
+
+static void simos_fs_mark(simos_fs_t *fs, size_t block, int used)
+{
+	if (used) {
+		fs->bitmap[block / 8] |= 1 << (block % 8);
+	} else {
+		fs->bitmap[block / 8] &= ~(1 << (block % 8));
+	}
+}
+
+/**
+ * Write back the buffer with, in the same batch, the oldest dirty ones,
+ * sorted by block so the device sweeps them in order.
+ */
+static void simos_fs_writeback(simos_fs_t *fs, simos_fs_buf_t *b)
+{
+	simos_fs_buf_t *batch[SIMOS_FS_BATCH], *tmp;
+	simos_list_node_t *n;
+	int len = 0, i, j;
+
+	batch[len++] = b;
+	for (n = fs->dirty->head; n && len < SIMOS_FS_BATCH; n = n->next) {
+		if (n->data != b) {
+			batch[len++] = n->data;
+		}
+	}
+
+	for (i = 1; i < len; i++) {
+		for (j = i; j > 0 && batch[j - 1]->block > batch[j]->block; j--) {
+			tmp = batch[j];
+			batch[j] = batch[j - 1];
+			batch[j - 1] = tmp;
+		}
+	}
+
+	for (i = 0; i < len; i++) {
+		memcpy(fs->image + batch[i]->block * SIMOS_FS_BLOCK,
+				batch[i]->data, SIMOS_FS_BLOCK);
+		batch[i]->dirty = 0;
+		simos_list_unlink(fs->dirty, &batch[i]->dirty_link);
+	}
+
+	fs->writebacks += len;
+	fs->batches++;
+	fs->last_io = batch[len - 1]->block;
+}
+
+/** Buffer to reuse: least recently used, or the first one CLOCK spares. */
+static simos_fs_buf_t *simos_fs_victim(simos_fs_t *fs)
+{
+	simos_fs_buf_t *b;
+
+	if (fs->policy == SIMOS_FS_CLOCK) {
+		while (fs->buf[fs->hand].ref) {
+			fs->buf[fs->hand].ref = 0;
+			fs->hand = (fs->hand + 1) % fs->nbuf;
+		}
+		b = &fs->buf[fs->hand];
+		fs->hand = (fs->hand + 1) % fs->nbuf;
+		return b;
+	}
+
+	return fs->lru->head->data;
+}
+
+static void simos_fs_unhash(simos_fs_t *fs, simos_fs_buf_t *b)
+{
+	simos_fs_buf_t **link = &fs->hash[simos_fs_hash(fs, b->block)];
+
+	while (*link != b) {
+		link = &(*link)->hash_next;
+	}
+	*link = b->hash_next;
+	b->hash_next = NULL;
+	b->valid = 0;
+}
+
+static void simos_fs_touch(simos_fs_t *fs, simos_fs_buf_t *b)
+{
+	if (fs->policy == SIMOS_FS_CLOCK) {
+		b->ref = 1;
+	} else {
+		simos_list_unlink(fs->lru, &b->lru);
+		simos_list_add(fs->lru, &b->lru);
+	}
+}
+
+/**
+ * Buffer of the block, O(1). On a miss the block is read from the image
+ * unless the whole of it is going to be written (fill false).
+ */
+static simos_fs_buf_t *simos_fs_get(simos_fs_t *fs, size_t block, int fill)
+{
+	simos_fs_buf_t *b = fs->hash[simos_fs_hash(fs, block)];
+
+	for (; b; b = b->hash_next) {
+		if (b->block == block) {
+			fs->hits++;
+			simos_fs_touch(fs, b);
+			return b;
+		}
+	}
+
+	b = simos_fs_victim(fs);
+	if (b->dirty) {
+		simos_fs_writeback(fs, b);
+	}
+	if (b->valid) {
+		simos_fs_unhash(fs, b);
+	}
+
+	b->block = block;
+	b->valid = 1;
+	b->hash_next = fs->hash[simos_fs_hash(fs, block)];
+	fs->hash[simos_fs_hash(fs, block)] = b;
+	simos_fs_touch(fs, b);
+
+	if (fill) {
+		memcpy(b->data, fs->image + block * SIMOS_FS_BLOCK, SIMOS_FS_BLOCK);
+		fs->misses++;
+		fs->last_io = block;
+	} else {
+		memset(b->data, 0, SIMOS_FS_BLOCK);
+	}
+
+	return b;
+}
+
+static void simos_fs_dirty(simos_fs_t *fs, simos_fs_buf_t *b)
+{
+	if (! b->dirty) {
+		b->dirty = 1;
+		simos_list_add(fs->dirty, &b->dirty_link);
+	}
+}
+
+/** Write back every dirty buffer. Return how many. */
+size_t simos_fs_sync(simos_fs_t *fs)
+{
+	size_t before = fs->writebacks;
+
+	while (! simos_list_empty(fs->dirty)) {
+		simos_fs_writeback(fs, fs->dirty->head->data);
+	}
+	msync(fs->image, fs->image_size, MS_ASYNC);
+
+	return fs->writebacks - before;
+}
+
+/*****************************************************************
+ * images
+ ****************************************************************/
+
+/** Format a new image of nblocks at path. */
+simos_fs_t *simos_fs_create(const char *path, size_t nblocks,
+		size_t ninodes, size_t nbuf, int policy)
+{
+	simos_fs_super_t super;
+	simos_fs_t *fs;
+	size_t i, size = nblocks * SIMOS_FS_BLOCK;
+	int fd;
+
+	super.magic = SIMOS_FS_MAGIC;
+	super.nblocks = nblocks;
+	super.ninodes = ninodes;
+	super.bitmap = 1;
+	super.inodes = super.bitmap
+		+ (nblocks + 8 * SIMOS_FS_BLOCK - 1) / (8 * SIMOS_FS_BLOCK);
+	super.data = super.inodes + (ninodes * sizeof(simos_fs_inode_t)
+			+ SIMOS_FS_BLOCK - 1) / SIMOS_FS_BLOCK;
+	if (super.data >= nblocks) {
+		return NULL;
+	}
+
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		return NULL;
+	}
+	if (ftruncate(fd, size) < 0) {
+		close(fd);
+		return NULL;
+	}
+
+	fs = simos_fs_mount(fd, size, nbuf, policy);
+	if (fs == NULL) {
+		return NULL;
+	}
+
+	/* a new file reads as zeros: no block used, no inode used */
+	*fs->super = super;
+	simos_fs_layout(fs);
+	for (i = 0; i < super.data; i++) {
+		simos_fs_mark(fs, i, 1);
+	}
+
+	return fs;
+}
+
+/** Mount the image at path. */
+simos_fs_t *simos_fs_open(const char *path, size_t nbuf, int policy)
+{
+	simos_fs_super_t super;
+	simos_fs_t *fs;
+	int fd;
+
+	fd = open(path, O_RDWR);
+	if (fd < 0) {
+		return NULL;
+	}
+	if (read(fd, &super, sizeof(super)) != sizeof(super)
+			|| super.magic != SIMOS_FS_MAGIC) {
+		close(fd);
+		return NULL;
+	}
+
+	fs = simos_fs_mount(fd, (size_t) super.nblocks * SIMOS_FS_BLOCK, nbuf,
+			policy);
+	if (fs) {
+		simos_fs_layout(fs);
+	}
+
+	return fs;
+}
+
+/** Write back every dirty buffer and unmount. */
+void simos_fs_destroy(simos_fs_t *fs)
+{
+	size_t i;
+
+	simos_fs_sync(fs);
+	munmap(fs->image, fs->image_size);
+	close(fs->fd);
+
+	for (i = 0; i < fs->nbuf; i++) {
+		free(fs->buf[i].data);
+	}
+	free(fs->buf);
+	free(fs->hash);
+	free(fs->lru);
+	free(fs->dirty);
+	free(fs);
+}
+
+/*****************************************************************
+ * files
+ ****************************************************************/
+
+static simos_fs_inode_t *simos_fs_inode(simos_fs_t *fs, int ino)
+{
+	if (ino < 0 || (unsigned int) ino >= fs->super->ninodes
+			|| ! fs->inodes[ino].used) {
+		return NULL;
+	}
+
+	return &fs->inodes[ino];
+}
+
+/** Create an empty file. Return its inode, -1 if none is free. */
+int simos_fs_creat(simos_fs_t *fs)
+{
+	unsigned int i;
+
+	for (i = 0; i < fs->super->ninodes; i++) {
+		if (! fs->inodes[i].used) {
+			fs->inodes[i].used = 1;
+			fs->inodes[i].nextents = 0;
+			fs->inodes[i].size = 0;
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+/** Remove the file and free its blocks. Return true or false. */
+int simos_fs_unlink(simos_fs_t *fs, int ino)
+{
+	simos_fs_inode_t *inode = simos_fs_inode(fs, ino);
+	simos_fs_extent_t *e;
+	simos_fs_buf_t *b;
+	size_t block;
+	unsigned int i;
+
+	if (inode == NULL) {
+		return 0;
+	}
+
+	for (i = 0; i < inode->nextents; i++) {
+		e = &inode->extent[i];
+		for (block = e->start; block < e->start + e->len; block++) {
+			simos_fs_mark(fs, block, 0);
+
+			/* a freed block is not written back */
+			for (b = fs->hash[simos_fs_hash(fs, block)]; b;
+					b = b->hash_next) {
+				if (b->block == block) {
+					if (b->dirty) {
+						b->dirty = 0;
+						simos_list_unlink(fs->dirty, &b->dirty_link);
+					}
+					simos_fs_unhash(fs, b);
+					break;
+				}
+			}
+		}
+	}
+	inode->used = 0;
+
+	return 1;
+}
+
+/** Size of the file, -1 if it does not exist. */
+size_t simos_fs_size(simos_fs_t *fs, int ino)
+{
+	simos_fs_inode_t *inode = simos_fs_inode(fs, ino);
+
+	return inode ? inode->size : (size_t) -1;
+}
+
+/** Disk block of the n-th block of the file, -1 past its extents. */
+static size_t simos_fs_bmap(simos_fs_inode_t *inode, size_t n)
+{
+	unsigned int i;
+
+	for (i = 0; i < inode->nextents; i++) {
+		if (n < inode->extent[i].len) {
+			return inode->extent[i].start + n;
+		}
+		n -= inode->extent[i].len;
+	}
+
+	return -1;
+}
+
+/**
+ * Give the file one more block, right after its last one when free so
+ * the extent just grows. Return the block, -1 if none.
+ */
+static size_t simos_fs_grow(simos_fs_t *fs, simos_fs_inode_t *inode)
+{
+	simos_fs_extent_t *last = NULL;
+	size_t block, goal = fs->super->data;
+
+	if (inode->nextents) {
+		last = &inode->extent[inode->nextents - 1];
+		goal = last->start + last->len;
+		if (goal < fs->super->nblocks && ! simos_fs_used(fs, goal)) {
+			simos_fs_mark(fs, goal, 1);
+			last->len++;
+			return goal;
+		}
+	}
+
+	if (inode->nextents == SIMOS_FS_EXTENTS) {
+		return -1;
+	}
+
+	for (block = goal; block < fs->super->nblocks; block++) {
+		if (! simos_fs_used(fs, block)) {
+			break;
+		}
+	}
+	if (block == fs->super->nblocks) {
+		for (block = fs->super->data; block < goal; block++) {
+			if (! simos_fs_used(fs, block)) {
+				break;
+			}
+		}
+		if (block == goal) {
+			return -1;
+		}
+	}
+
+	simos_fs_mark(fs, block, 1);
+	inode->extent[inode->nextents].start = block;
+	inode->extent[inode->nextents].len = 1;
+	inode->nextents++;
+
+	return block;
+}
+
+/** Read len bytes of the file from offset on. */
+size_t simos_fs_read(simos_fs_t *fs, int ino, size_t offset, void *buf,
+		size_t len)
+{
+	simos_fs_inode_t *inode = simos_fs_inode(fs, ino);
+	simos_fs_buf_t *b;
+	size_t done = 0, part, in;
+
+	if (inode == NULL) {
+		return -1;
+	}
+
+	if (offset >= inode->size) {
+		return 0;
+	}
+	if (len > inode->size - offset) {
+		len = inode->size - offset;
+	}
+
+	while (done < len) {
+		in = (offset + done) % SIMOS_FS_BLOCK;
+		part = SIMOS_FS_BLOCK - in;
+		if (part > len - done) {
+			part = len - done;
+		}
+
+		b = simos_fs_get(fs, simos_fs_bmap(inode,
+					(offset + done) / SIMOS_FS_BLOCK), 1);
+		memcpy((unsigned char *) buf + done, b->data + in, part);
+		done += part;
+	}
+
+	return done;
+}
+
+/** Write len bytes to the file from offset on, growing it as needed. */
+size_t simos_fs_write(simos_fs_t *fs, int ino, size_t offset,
+		const void *buf, size_t len)
+{
+	simos_fs_inode_t *inode = simos_fs_inode(fs, ino);
+	simos_fs_buf_t *b;
+	size_t done = 0, part, in, n, block;
+
+	if (inode == NULL) {
+		return -1;
+	}
+
+	while (done < len) {
+		in = (offset + done) % SIMOS_FS_BLOCK;
+		part = SIMOS_FS_BLOCK - in;
+		if (part > len - done) {
+			part = len - done;
+		}
+
+		n = (offset + done) / SIMOS_FS_BLOCK;
+		/* new blocks, holes included, read as zeros */
+		while ((block = simos_fs_bmap(inode, n)) == (size_t) -1) {
+			if ((block = simos_fs_grow(fs, inode)) == (size_t) -1) {
+				return done;
+			}
+			simos_fs_dirty(fs, simos_fs_get(fs, block, 0));
+		}
+
+		/* a whole block, or past the end of the file, is not read */
+		b = simos_fs_get(fs, block, part < SIMOS_FS_BLOCK
+				&& n * SIMOS_FS_BLOCK < inode->size);
+		memcpy(b->data + in, (const unsigned char *) buf + done, part);
+		simos_fs_dirty(fs, b);
+		done += part;
+
+		if (offset + done > inode->size) {
+			inode->size = offset + done;
+		}
+	}
+
+	return done;
+}
@@ -0,0 +1,138 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 ljr-ifsp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include "simos.h"
+
+simos_group_t *simos_group_new(simos_group_t *parent, const char *name,
+		size_t weight, size_t quota, size_t period, size_t mem_limit)
+{
+	simos_group_t *g = malloc(sizeof(simos_group_t));
+
+	strncpy(g->name, name, sizeof(g->name) - 1);
+	g->name[sizeof(g->name) - 1] = '\0';
+	g->parent = parent;
+	g->child = NULL;
+	g->sibling = NULL;
+	if (parent) {
+		g->sibling = parent->child;
+		parent->child = g;
+	}
+
+	g->weight = weight ? weight : 1;
+	g->quota = parent ? quota : 0;
+	g->period = period ? period : 1;
+	g->mem_limit = mem_limit;
+	g->mem_usage = 0;
+
+	g->procs = simos_rb_new();
+	g->kids = simos_rb_new();
+	g->rb.data = g;
+	g->rb.key = 0;
+	g->mem_peak = 0;
+	g->mem_failures = 0;
+
+	simos_group_reset(g);
+	return g;
+}
+
+void simos_group_destroy(simos_group_t *g)
+{
+	simos_group_t *c, *next;
+
+	for (c = g->child; c; c = next) {
+		next = c->sibling;
+		simos_group_destroy(c);
+	}
+	free(g->procs);
+	free(g->kids);
+	free(g);
+}
+
+int simos_group_charge(simos_group_t *g, size_t len)
+{
+	simos_group_t *a;
+
+	for (a = g; a; a = a->parent) {
+		if (a->mem_limit && a->mem_usage + len > a->mem_limit) {
+			a->mem_failures++;
+			return 0;
+		}
+	}
+
+	for (a = g; a; a = a->parent) {
+		a->mem_usage += len;
+		if (a->mem_usage > a->mem_peak) {
+			a->mem_peak = a->mem_usage;
+		}
+	}
+	return 1;
+}
+
+void simos_group_uncharge(simos_group_t *g, size_t len)
+{
+	for (; g; g = g->parent) {
+		g->mem_usage -= (len < g->mem_usage) ? len : g->mem_usage;
+	}
+}
+
+simos_group_t *simos_group_run(simos_group_t *g, size_t ran, size_t now)
+{
+	simos_group_t *out = NULL;
+
+	for (; g; g = g->parent) {
+		g->cpu_time += ran;
+		if (g->quota == 0) {
+			continue;
+		}
+
+		if (now >= g->period_start + g->period) {
+			g->period_start = now - (now - g->period_start) % g->period;
+			g->used = 0;
+		}
+		g->used += ran;
+		if (g->used >= g->quota) {
+			out = g;
+		}
+	}
+	return out;
+}
+
+void simos_group_reset(simos_group_t *g)
+{
+	simos_group_t *c;
+
+	g->queued = 0;
+	g->vruntime = 0;
+	g->min_vruntime = 0;
+	g->load = 0;
+	g->used = 0;
+	g->period_start = 0;
+	g->throttled = 0;
+	g->cpu_time = 0;
+	g->throttles = 0;
+	for (c = g->child; c; c = c->sibling) {
+		simos_group_reset(c);
+	}
+}
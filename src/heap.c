@@ -0,0 +1,195 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 ljr-ifsp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <malloc.h>
+#include "simos.h"
+
+/*****************************************************************
+ * Binary min-heap
+ ****************************************************************/
+
+/**
+ * Allocate room for a heap.
+ */
+simos_heap_t *simos_heap_new()
+{
+	simos_heap_t *h = malloc(sizeof(simos_heap_t));
+
+	h->nodes = NULL;
+	h->len = 0;
+	h->size = 0;
+	h->seq = 0;
+
+	return h;
+}
+
+/**
+ * Free the heap, not the data.
+ */
+void simos_heap_free(simos_heap_t *heap)
+{
+	free(heap->nodes);
+	free(heap);
+}
+
+/**
+ * Is the heap empty?
+ */
+int simos_heap_empty(simos_heap_t *heap)
+{
+	return heap->len == 0;
+}
+
+/** Does a come before b? Equal keys in insertion order. */
+static int simos_heap_less(simos_heap_node_t *a, simos_heap_node_t *b)
+{
+	return a->key < b->key || (a->key == b->key && a->seq < b->seq);
+}
+
+/**
+ * Push data with the key, O(log n).
+ */
+void simos_heap_push(simos_heap_t *heap, size_t key, void *data)
+{
+	simos_heap_node_t node;
+	size_t i, parent;
+
+	if (heap->len == heap->size) {
+		heap->size = heap->size ? 2 * heap->size : 64;
+		heap->nodes = realloc(heap->nodes,
+				heap->size * sizeof(simos_heap_node_t));
+	}
+
+	node.key = key;
+	node.seq = heap->seq++;
+	node.data = data;
+
+	for (i = heap->len++; i > 0; i = parent) {
+		parent = (i - 1) / 2;
+		if (! simos_heap_less(&node, &heap->nodes[parent])) {
+			break;
+		}
+		heap->nodes[i] = heap->nodes[parent];
+	}
+	heap->nodes[i] = node;
+}
+
+/**
+ * Node with the smallest key, NULL if empty. O(1).
+ */
+simos_heap_node_t *simos_heap_top(simos_heap_t *heap)
+{
+	return heap->len ? &heap->nodes[0] : NULL;
+}
+
+/**
+ * Remove the node with the smallest key and return its data, O(log n).
+ */
+void *simos_heap_pop(simos_heap_t *heap)
+{
+	simos_heap_node_t last;
+	void *data;
+	size_t i, child;
+
+	if (heap->len == 0) {
+		return NULL;
+	}
+
+	data = heap->nodes[0].data;
+	last = heap->nodes[--heap->len];
+
+	for (i = 0; (child = 2 * i + 1) < heap->len; i = child) {
+		if (child + 1 < heap->len
+				&& simos_heap_less(&heap->nodes[child + 1],
+					&heap->nodes[child])) {
+			child++;
+		}
+		if (! simos_heap_less(&heap->nodes[child], &last)) {
+			break;
+		}
+		heap->nodes[i] = heap->nodes[child];
+	}
+	if (heap->len) {
+		heap->nodes[i] = last;
+	}
+
+	return data;
+}
+
+
+/*****************************************************************
+ * Fenwick (binary indexed) tree
+ ****************************************************************/
+
+/**
+ * Create a tree of `len' counts, all zero.
+ */
+simos_fenwick_t *simos_fenwick_new(size_t len)
+{
+	simos_fenwick_t *f = malloc(sizeof(simos_fenwick_t));
+
+	f->len = len;
+	f->tree = calloc(len + 1, sizeof(size_t));
+	f->total = 0;
+
+	return f;
+}
+
+void simos_fenwick_free(simos_fenwick_t *f)
+{
+	free(f->tree);
+	free(f);
+}
+
+/**
+ * Add delta (may be negative) to the count at index i, O(log n).
+ */
+void simos_fenwick_add(simos_fenwick_t *f, size_t i, long delta)
+{
+	f->total += delta;
+	for (i++; i <= f->len; i += i & -i) {
+		f->tree[i] += delta;
+	}
+}
+
+/**
+ * Index whose counts cover `target': the smallest i such that the sum of
+ * counts 0..i is greater than target. O(log n).
+ */
+size_t simos_fenwick_find(simos_fenwick_t *f, size_t target)
+{
+	size_t pos = 0;
+	size_t step = 1;
+
+	while (step * 2 <= f->len) {
+		step *= 2;
+	}
+
+	for (; step; step /= 2) {
+		if (pos + step <= f->len && f->tree[pos + step] <= target) {
+			pos += step;
+			target -= f->tree[pos];
+		}
+	}
+
+	return pos;
+}
@@ -0,0 +1,238 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 ljr-ifsp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include "simos.h"
+
+/** Create `ndev' idle devices. */
+simos_io_t *simos_io_create(int ndev)
+{
+	simos_io_t *io = malloc(sizeof(simos_io_t));
+	int i;
+
+	if (ndev < 1) {
+		ndev = 1;
+	}
+
+	io->ndev = ndev;
+	io->dev = malloc(ndev * sizeof(simos_device_t));
+	for (i = 0; i < ndev; i++) {
+		io->dev[i].queue = simos_list_new();
+		io->dev[i].busy = NULL;
+		io->dev[i].done_at = 0;
+		io->dev[i].disk = NULL;
+	}
+	io->events = simos_heap_new();
+	io->pending = 0;
+	io->fs = NULL;
+	simos_io_reset(io);
+
+	return io;
+}
+
+void simos_io_destroy(simos_io_t *io)
+{
+	int i;
+
+	for (i = 0; i < io->ndev; i++) {
+		free(io->dev[i].queue);
+		if (io->dev[i].disk) {
+			simos_disk_destroy(io->dev[i].disk);
+		}
+	}
+	free(io->dev);
+	if (io->fs) {
+		simos_fs_destroy(io->fs);
+	}
+	simos_heap_free(io->events);
+	free(io);
+}
+
+/** Forget the statistics. */
+void simos_io_reset(simos_io_t *io)
+{
+	int i;
+
+	for (i = 0; i < io->ndev; i++) {
+		io->dev[i].requests = 0;
+		io->dev[i].busy_time = 0;
+		if (io->dev[i].disk) {
+			simos_disk_reset(io->dev[i].disk);
+		}
+	}
+
+	if (io->fs) {
+		io->fs->hits = 0;
+		io->fs->misses = 0;
+		io->fs->writebacks = 0;
+		io->fs->batches = 0;
+	}
+}
+
+/** The device starts serving its next request at `now', if any. */
+static void simos_io_start(simos_io_t *io, simos_device_t *dev, size_t now)
+{
+	simos_list_node_t *node;
+	simos_process_t *p;
+	size_t len;
+
+	if (dev->disk) {
+		node = simos_disk_next(dev->disk, now, &len);
+	} else if ((node = simos_list_del_head(dev->queue)) != NULL) {
+		node->next = node->prev = NULL;
+		p = simos_node_to_process(node);
+		len = simos_process_draw(p, p->io_burst);
+	}
+
+	if (node == NULL) {
+		return;
+	}
+
+	dev->busy = node;
+	dev->done_at = now + len;
+	dev->requests++;
+	dev->busy_time += len;
+	simos_heap_push(io->events, dev->done_at, dev);
+}
+
+/**
+ * Sector of the next request of the process: right after its last one
+ * most of the time, anywhere on the disk otherwise.
+ */
+static size_t simos_io_sector(simos_disk_t *disk, simos_process_t *p)
+{
+	if ((size_t) (rand_r(&p->seed) % 100) >= disk->locality) {
+		p->sector = rand_r(&p->seed) % simos_disk_size(disk);
+	}
+
+	return p->sector;
+}
+
+/**
+ * The I/O burst of the process on its file, block by block through the
+ * buffer cache. Return how many blocks the device reads or writes.
+ */
+static size_t simos_io_file(simos_fs_t *fs, simos_process_t *p)
+{
+	unsigned char data[SIMOS_FS_BLOCK];
+	size_t before = fs->misses + fs->writebacks;
+	size_t i, count = simos_process_draw(p, p->io_burst);
+	int write;
+
+	if (p->file < 0 && (p->file = simos_fs_creat(fs)) < 0) {
+		return 0;
+	}
+
+	for (i = 0; i < count; i++) {
+		write = (size_t) (rand_r(&p->seed) % 100) < fs->writes;
+		if (write) {
+			memset(data, p->pid, SIMOS_FS_BLOCK);
+			if (simos_fs_write(fs, p->file, p->file_offset, data,
+						SIMOS_FS_BLOCK) != SIMOS_FS_BLOCK) {
+				p->file_offset = 0; // the file is as big as it gets
+				continue;
+			}
+		} else if (simos_fs_read(fs, p->file, p->file_offset, data,
+					SIMOS_FS_BLOCK) == 0) {
+			p->file_offset = 0; // read it again from the start
+			continue;
+		}
+		p->file_offset += SIMOS_FS_BLOCK;
+	}
+
+	return fs->misses + fs->writebacks - before;
+}
+
+/** The process in the node starts an I/O burst at `now'. */
+int simos_io_submit(simos_io_t *io, simos_list_node_t *node, size_t now)
+{
+	simos_process_t *p = simos_node_to_process(node);
+	simos_device_t *dev = &io->dev[p->device % io->ndev];
+	size_t count, blocks = 0;
+
+	if (io->fs && (blocks = simos_io_file(io->fs, p)) == 0) {
+		return 0;
+	}
+
+	p->state = SIMOS_BLOCKED;
+	p->io_time -= now; // the rest is added at completion
+	io->pending++;
+
+	node->next = node->prev = NULL;
+	if (dev->disk && io->fs) {
+		simos_disk_add(dev->disk, node,
+				io->fs->last_io * SIMOS_FS_SECTORS,
+				blocks * SIMOS_FS_SECTORS, now);
+	} else if (dev->disk) {
+		count = simos_process_draw(p, p->io_burst);
+		simos_disk_add(dev->disk, node, simos_io_sector(dev->disk, p),
+				count, now);
+		p->sector += count;
+	} else {
+		simos_list_add(dev->queue, node);
+	}
+
+	if (dev->busy == NULL) {
+		simos_io_start(io, dev, now);
+	}
+
+	return 1;
+}
+
+/** A node whose I/O is over by `now', NULL if none. */
+simos_list_node_t *simos_io_complete(simos_io_t *io, size_t now)
+{
+	simos_heap_node_t *top = simos_heap_top(io->events);
+	simos_device_t *dev;
+	simos_list_node_t *node;
+	simos_process_t *p;
+	size_t done;
+
+	if (top == NULL || top->key > now) {
+		return NULL;
+	}
+
+	dev = simos_heap_pop(io->events);
+	node = dev->busy;
+	done = dev->done_at;
+	dev->busy = NULL;
+
+	/* the next request starts right when this one is over */
+	simos_io_start(io, dev, done);
+
+	p = simos_node_to_process(node);
+	p->state = SIMOS_READY;
+	p->io_time += done;
+	io->pending--;
+
+	return node;
+}
+
+/** Time of the next completion, -1 if no request is pending. */
+size_t simos_io_next(simos_io_t *io)
+{
+	simos_heap_node_t *top = simos_heap_top(io->events);
+
+	return top ? top->key : (size_t) -1;
+}
@@ -0,0 +1,275 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 ljr-ifsp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include "simos.h"
+
+static simos_chan_t *simos_chan_new(int type, size_t cap, size_t msg_max)
+{
+	simos_chan_t *c = malloc(sizeof(simos_chan_t));
+
+	c->type = type;
+	c->cap = cap;
+	c->msg_max = msg_max;
+	c->buf = malloc(type == SIMOS_IPC_MQ ? cap * msg_max : cap);
+	c->sizes = (type == SIMOS_IPC_MQ) ? malloc(cap * sizeof(size_t)) : NULL;
+	c->head = 0;
+	c->len = 0;
+	c->readers = 0;
+	c->writers = 0;
+	c->senders = simos_list_new();
+	c->receivers = simos_list_new();
+
+	c->bytes = 0;
+	c->messages = 0;
+	c->send_waits = 0;
+	c->recv_waits = 0;
+
+	return c;
+}
+
+simos_chan_t *simos_pipe_new(size_t cap)
+{
+	return simos_chan_new(SIMOS_IPC_PIPE, cap, 0);
+}
+
+simos_chan_t *simos_mq_new(size_t cap, size_t msg_max)
+{
+	return simos_chan_new(SIMOS_IPC_MQ, cap, msg_max);
+}
+
+void simos_chan_destroy(simos_chan_t *c)
+{
+	free(c->buf);
+	free(c->sizes);
+	free(c->senders);
+	free(c->receivers);
+	free(c);
+}
+
+/**
+ * Move from the process' transfer into the ring. A pipe takes what fits,
+ * a queue a whole message when a slot is free. Return true whether
+ * something moved.
+ */
+static int simos_chan_push(simos_chan_t *c, simos_process_t *p)
+{
+	size_t tail, n, first;
+
+	if (c->type == SIMOS_IPC_MQ) {
+		if (c->len == c->cap) {
+			return 0;
+		}
+		tail = (c->head + c->len) % c->cap;
+		if (p->ipc_data) {
+			memcpy(c->buf + tail * c->msg_max, p->ipc_data, p->ipc_left);
+		}
+		c->sizes[tail] = p->ipc_left;
+		c->len++;
+		c->bytes += p->ipc_left;
+		p->ipc_done = p->ipc_left;
+		p->ipc_left = 0;
+		return 1;
+	}
+
+	n = c->cap - c->len;
+	if (n > p->ipc_left) {
+		n = p->ipc_left;
+	}
+	if (n == 0) {
+		return 0;
+	}
+
+	/* the free room may wrap around the end of the ring */
+	tail = (c->head + c->len) % c->cap;
+	first = (n < c->cap - tail) ? n : c->cap - tail;
+	if (p->ipc_data) {
+		memcpy(c->buf + tail, p->ipc_data, first);
+		memcpy(c->buf, p->ipc_data + first, n - first);
+		p->ipc_data += n;
+	}
+	c->len += n;
+	c->bytes += n;
+	p->ipc_done += n;
+	p->ipc_left -= n;
+
+	return 1;
+}
+
+/** Move from the ring into the process' transfer, see simos_chan_push. */
+static int simos_chan_pull(simos_chan_t *c, simos_process_t *p)
+{
+	size_t n, first;
+
+	if (c->len == 0) {
+		return 0;
+	}
+
+	if (c->type == SIMOS_IPC_MQ) {
+		n = c->sizes[c->head];
+		if (p->ipc_data) {
+			memcpy(p->ipc_data, c->buf + c->head * c->msg_max,
+					(n < p->ipc_left) ? n : p->ipc_left);
+		}
+		c->head = (c->head + 1) % c->cap;
+		c->len--;
+		c->messages++;
+		p->ipc_done = (n < p->ipc_left) ? n : p->ipc_left;
+		p->ipc_left = 0;
+		return 1;
+	}
+
+	n = (c->len < p->ipc_left) ? c->len : p->ipc_left;
+	if (n == 0) {
+		return 0;
+	}
+
+	first = (n < c->cap - c->head) ? n : c->cap - c->head;
+	if (p->ipc_data) {
+		memcpy(p->ipc_data, c->buf + c->head, first);
+		memcpy(p->ipc_data + first, c->buf, n - first);
+		p->ipc_data += n;
+	}
+	c->head = (c->head + n) % c->cap;
+	c->len -= n;
+	p->ipc_done += n;
+	p->ipc_left -= n;
+	if (p->ipc_left == 0) {
+		c->messages++;
+	}
+
+	return 1;
+}
+
+/** Queue the node to wait on the list of the channel. */
+static void simos_chan_block(simos_list_t *waiters, simos_list_node_t *node,
+		size_t now)
+{
+	simos_process_t *p = simos_node_to_process(node);
+
+	p->state = SIMOS_BLOCKED;
+	p->sync_time -= now; // the rest is added when woken
+
+	node->next = node->prev = NULL;
+	simos_list_add(waiters, node);
+}
+
+/** The first waiter of the list is done, take it out. */
+static simos_list_node_t *simos_chan_unblock(simos_list_t *waiters,
+		size_t now)
+{
+	simos_list_node_t *node = simos_list_del_head(waiters);
+	simos_process_t *p = simos_node_to_process(node);
+
+	node->next = node->prev = NULL;
+	p->state = SIMOS_READY;
+	p->sync_time += now;
+
+	return node;
+}
+
+int simos_chan_send(simos_chan_t *c, simos_list_node_t *node,
+		const void *data, size_t n, size_t now)
+{
+	simos_process_t *p = simos_node_to_process(node);
+
+	if (c->readers == 0 || (c->type == SIMOS_IPC_MQ && n > c->msg_max)) {
+		return -1;
+	}
+
+	p->ipc_data = (char *) data;
+	p->ipc_left = n;
+	p->ipc_done = 0;
+
+	// nobody jumps the queue
+	if (simos_list_empty(c->senders)) {
+		simos_chan_push(c, p);
+		if (p->ipc_left == 0) {
+			return 1;
+		}
+	}
+
+	c->send_waits++;
+	simos_chan_block(c->senders, node, now);
+	return 0;
+}
+
+int simos_chan_recv(simos_chan_t *c, simos_list_node_t *node,
+		void *data, size_t n, size_t now)
+{
+	simos_process_t *p = simos_node_to_process(node);
+
+	p->ipc_data = data;
+	p->ipc_left = n;
+	p->ipc_done = 0;
+
+	if (simos_list_empty(c->receivers)) {
+		simos_chan_pull(c, p);
+		if (p->ipc_left == 0 || (c->len == 0 && c->writers == 0)) {
+			return 1;
+		}
+	}
+
+	c->recv_waits++;
+	simos_chan_block(c->receivers, node, now);
+	return 0;
+}
+
+void simos_chan_close(simos_chan_t *c, int writer)
+{
+	if (writer) {
+		c->writers--;
+	} else {
+		c->readers--;
+	}
+}
+
+simos_list_node_t *simos_chan_wake(simos_chan_t *c, size_t now)
+{
+	simos_process_t *p;
+	int moved;
+
+	do {
+		moved = 0;
+
+		if (! simos_list_empty(c->receivers)) {
+			p = simos_node_to_process(c->receivers->head);
+			moved |= simos_chan_pull(c, p);
+			if (p->ipc_left == 0 || (c->len == 0 && c->writers == 0)) {
+				return simos_chan_unblock(c->receivers, now);
+			}
+		}
+
+		if (! simos_list_empty(c->senders)) {
+			p = simos_node_to_process(c->senders->head);
+			moved |= simos_chan_push(c, p);
+			// nobody left to read: the rest is lost
+			if (p->ipc_left == 0 || c->readers == 0) {
+				return simos_chan_unblock(c->senders, now);
+			}
+		}
+	} while (moved);
+
+	return NULL;
+}
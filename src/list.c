@@ -105,6 +105,27 @@ void simos_list_add_after(simos_list_t *list, simos_list_node_t *node,
 	}
 }
 
+/**
+ * Move every node of `other' to the tail of the list.
+ */
+void simos_list_append(simos_list_t *list, simos_list_t *other)
+{
+	if (simos_list_empty(other)) {
+		return;
+	}
+
+	if (simos_list_empty(list)) {
+		list->head = other->head;
+	} else {
+		list->tail->next = other->head;
+		other->head->prev = list->tail;
+	}
+	list->tail = other->tail;
+
+	other->head = NULL;
+	other->tail = NULL;
+}
+
 /**
  * Delete an especific node in the list. Return true of false.
  */
@@ -179,13 +200,34 @@ simos_list_node_t *simos_list_del_tail(simos_list_t *list)
 	return n;
 }
 
+/**
+ * Take the node out of the list in O(1), it must be in the list.
+ */
+void simos_list_unlink(simos_list_t *list, simos_list_node_t *node)
+{
+	if (node->prev) {
+		node->prev->next = node->next;
+	} else {
+		list->head = node->next;
+	}
+
+	if (node->next) {
+		node->next->prev = node->prev;
+	} else {
+		list->tail = node->prev;
+	}
+
+	node->next = node->prev = NULL;
+}
+
 /**
  * Free all pointers in the list.
  */
 void simos_list_free(simos_list_t *list)
 {
-	simos_list_node_t *n;
-	SIMOS_LIST_FOREACH(n, list) {
+	simos_list_node_t *n, *next;
+	for (n = list->head; n; n = next) {
+		next = n->next;
 		free(n->data);
 		free(n);
 	}
@@ -233,6 +275,16 @@ int get_remaining_time(simos_list_node_t *node)
 	return 0;
 }
 
+/** Get burst_estimate of the process in the node */
+int get_burst_estimate(simos_list_node_t *node)
+{
+	if (node) {
+		return simos_node_to_process(node)->burst_estimate;
+	}
+
+	return 0;
+}
+
 /** Get priority of the process in the node */
 int get_priority(simos_list_node_t *node)
 {
@@ -21,9 +21,14 @@
  * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <malloc.h>
 #include "simos.h"
 
+static simos_memory_stats_t *simos_memory_stats_create(size_t size);
+static void simos_memory_stats_destroy(simos_memory_stats_t *st);
+
 /** Create a memory with the refered size. */
 simos_memory_t *simos_memory_create(size_t size)
 {
@@ -32,6 +37,12 @@ simos_memory_t *simos_memory_create(size_t size)
 
     mem->size = size;
     mem->cells = calloc(size, sizeof(unsigned char)); // set memory to zero...
+    mem->bmp = NULL;
+    mem->lmem = NULL;
+    mem->compact = NULL;
+    mem->heap = NULL;
+    mem->stats = simos_memory_stats_create(size);
+    simos_memory_stats_free(mem, 0, size); // one free extent
 
     return mem;
 }
@@ -39,6 +50,7 @@ simos_memory_t *simos_memory_create(size_t size)
 /** Call free (malloc(3)) in the allocated memory. */
 void simos_memory_destroy(simos_memory_t *mem)
 {
+    simos_memory_stats_destroy(mem->stats);
     free(mem->cells);
     free(mem);
 }
@@ -68,6 +80,8 @@ simos_memory_conf_t *create_memory_conf()
 
 	c->bmp = 0;
 	c->list = 0;
+	c->compact = 0;
+	c->paging = 0;
 
 	return c;
 }
@@ -99,7 +113,7 @@ void simos_memory_list_add(simos_list_t *memlist, simos_memory_block_t *block)
 
 size_t simos_memory_list_alloc(simos_memory_t *mem, size_t blocklen)
 {
-	int pointer = 0;
+	int pointer = -1;
 	int found = 0;
 	simos_list_node_t *n, *nn;
 	simos_memory_block_t *b, *bb;
@@ -113,6 +127,9 @@ size_t simos_memory_list_alloc(simos_memory_t *mem, size_t blocklen)
 
 	if (found) {
 		pointer = allocator(mem, b->pointer, blocklen);
+		if (pointer == -1) {
+			return -1;
+		}
 
 		bb = simos_memory_block_create(b->pointer+blocklen, b->blocklen-blocklen);
 		nn = simos_list_new_node(bb);
@@ -132,6 +149,12 @@ size_t simos_memory_list_alloc(simos_memory_t *mem, size_t blocklen)
 size_t allocator(simos_memory_t *mem, size_t pointer, size_t block)
 {
 	int i;
+	if (! simos_memory_stats_alloc(mem, pointer, block)) {
+		/* taken cells: the allocator and the stats disagree */
+		printf("[MEM] %d cells at %d are not free\n", (int) block,
+				(int) pointer);
+		return -1;
+	}
 	for (i = pointer; i < (pointer + block); i++) {
 		mem->cells[i] = 1;
 	}
@@ -153,6 +176,7 @@ size_t simos_memory_alloc(simos_memory_t *mem, size_t block)
         //printf("[MEM] Gap found at %d\n", i);
 
         /* measure gap's size */
+        available = 0;
         while (i < mem->size && available < block && mem->cells[i] == 0) {
             i++;
             available++;
@@ -160,9 +184,8 @@ size_t simos_memory_alloc(simos_memory_t *mem, size_t block)
 
         if (available == block) {
             pointer = i - block;
-            allocator(mem, pointer, block);
-            return pointer;
-        } else if (i > mem->size) {
+            return allocator(mem, pointer, block);
+        } else if (i >= mem->size) {
             //printf("Not enough space... No memory allocated.");
             return -1;
         }
@@ -170,25 +193,42 @@ size_t simos_memory_alloc(simos_memory_t *mem, size_t block)
 
 }
 
+/**
+ * Set the units of the bit map over cells [pointer, pointer+length) from
+ * the cells: a unit is taken whether any of its cells is.
+ */
+static void simos_memory_bmp_sync(simos_memory_t *mem, size_t pointer,
+		size_t length)
+{
+	simos_memory_bmp_t *bmp = mem->bmp;
+	size_t u, i;
+
+	for (u = pointer / bmp->unit; u <= (pointer + length - 1) / bmp->unit
+			&& u / 8 < SIMOS_BMP_SIZE; u++) {
+		bmp->map[u / 8] &= ~(1 << (u % 8));
+		for (i = u * bmp->unit; i < (u + 1) * bmp->unit && i < mem->size;
+				i++) {
+			if (mem->cells[i]) {
+				bmp->map[u / 8] |= 1 << (u % 8);
+				break;
+			}
+		}
+	}
+}
+
 size_t simos_memory_bmp_alloc(simos_memory_t *mem, size_t block)
 {
 	simos_memory_bmp_t *bmp = mem->bmp;
 
 	int i = 0, j = 0;
 	int pointer = -1;
-	int curr, prev = 0;
-	int currval = 0, preval = 0;
 	unsigned char control;
 
 	int z;
 	for(z=0; (z<SIMOS_BMP_SIZE) && (j<block); z++) {
-		curr = z;
-		prev = (curr > 0) ? curr-1 : 0;
-		preval = currval;
-		currval = 0;
 		control = 1;
 		for(;control && (j<block);) {
-			if(!(bmp->map[curr] & control)) {
+			if(!(bmp->map[z] & control)) {
 
 				if (pointer == -1) {
 					pointer = i;
@@ -196,12 +236,8 @@ size_t simos_memory_bmp_alloc(simos_memory_t *mem, size_t block)
 				} else {
 					j += bmp->unit ;
 				}
-
-				currval += control;
 			} else {
 				pointer = -1;
-				if (currval > 0) currval = 0;
-				if (prev > 0)  preval = 0;
 			}
 
 			control = control << 1;
@@ -209,9 +245,16 @@ size_t simos_memory_bmp_alloc(simos_memory_t *mem, size_t block)
 		}
 	}
 
+	if (j < block || block == 0) {
+		return -1;
+	}
+
+	/* the block may span any number of bytes of the map */
 	pointer = allocator(mem, pointer*(bmp->unit), block);
-	bmp->map[curr] += currval;
-	bmp->map[prev] += preval;
+	if (pointer == -1) {
+		return -1;
+	}
+	simos_memory_bmp_sync(mem, pointer, block);
 
 	return pointer;
 }
@@ -220,9 +263,714 @@ size_t simos_memory_bmp_alloc(simos_memory_t *mem, size_t block)
 void simos_memory_free(simos_memory_t *mem, size_t pointer, size_t length)
 {
     int i;
+    simos_memory_stats_free(mem, pointer, length);
     for (i = pointer; i < (pointer + length); i++) {
         mem->cells[i] = 0;
     }
 }
 
 
+/*****************************************************************
+ * Fragmentation metrics
+ ****************************************************************/
+#define SIMOS_LONG_BITS (8 * sizeof(unsigned long))
+
+static simos_memory_stats_t *simos_memory_stats_create(size_t size)
+{
+	simos_memory_stats_t *st = malloc(sizeof(simos_memory_stats_t));
+
+	st->tag = calloc(size, sizeof(size_t));
+	st->count = calloc(size + 1, sizeof(size_t));
+	st->lengths = calloc(size / SIMOS_LONG_BITS + 1, sizeof(unsigned long));
+	st->free = 0;
+	st->extents = 0;
+	st->largest = 0;
+	memset(st->hist, 0, sizeof(st->hist));
+
+	st->interval = 0;
+	st->next = 0;
+	st->samples = NULL;
+	st->nsamples = 0;
+	st->maxsamples = 0;
+
+	return st;
+}
+
+static void simos_memory_stats_destroy(simos_memory_stats_t *st)
+{
+	free(st->tag);
+	free(st->count);
+	free(st->lengths);
+	free(st->samples);
+	free(st);
+}
+
+/** Histogram bucket of an extent length: floor(log2(len)). */
+static int simos_memory_stats_bucket(size_t len)
+{
+	int b = SIMOS_LONG_BITS - 1 - __builtin_clzl(len);
+
+	return b < SIMOS_MEMORY_HIST ? b : SIMOS_MEMORY_HIST - 1;
+}
+
+static void simos_memory_extent_add(simos_memory_stats_t *st,
+		size_t start, size_t len)
+{
+	st->tag[start] = len;
+	st->tag[start + len - 1] = len;
+
+	if (st->count[len]++ == 0) {
+		st->lengths[len / SIMOS_LONG_BITS] |= 1UL << (len % SIMOS_LONG_BITS);
+	}
+	st->hist[simos_memory_stats_bucket(len)]++;
+	st->free += len;
+	st->extents++;
+
+	if (len > st->largest) {
+		st->largest = len;
+	}
+}
+
+static void simos_memory_extent_del(simos_memory_stats_t *st, size_t len)
+{
+	size_t w;
+	unsigned long bits;
+
+	if (--st->count[len] == 0) {
+		st->lengths[len / SIMOS_LONG_BITS] &= ~(1UL << (len % SIMOS_LONG_BITS));
+	}
+	st->hist[simos_memory_stats_bucket(len)]--;
+	st->free -= len;
+	st->extents--;
+
+	if (len != st->largest || st->count[len]) {
+		return;
+	}
+
+	/*
+	 * The largest is gone: next one is the highest bit below it. This
+	 * walks the words of `lengths', O(size / 64) in the worst case, only
+	 * when the last extent of the largest length is taken; every other
+	 * update is O(1).
+	 */
+	st->largest = 0;
+	w = len / SIMOS_LONG_BITS;
+	bits = st->lengths[w];
+	while (1) {
+		if (bits) {
+			st->largest = w * SIMOS_LONG_BITS
+				+ SIMOS_LONG_BITS - 1 - __builtin_clzl(bits);
+			break;
+		}
+		if (w == 0) {
+			break;
+		}
+		bits = st->lengths[--w];
+	}
+}
+
+/**
+ * Account cells [pointer, pointer+length) as allocated. They must lie in
+ * one free extent. Allocators place blocks at the start of an extent, so
+ * the extent is found by its tag; otherwise its start is searched to the
+ * left. Return 0, accounting nothing, whether the range is not in a free
+ * extent.
+ */
+int simos_memory_stats_alloc(simos_memory_t *mem, size_t pointer,
+		size_t length)
+{
+	simos_memory_stats_t *st = mem->stats;
+	size_t start = pointer;
+	size_t end;
+
+	if (length == 0) {
+		return 1;
+	}
+	if (pointer >= mem->size || length > mem->size - pointer
+			|| mem->cells[pointer]) {
+		return 0;
+	}
+
+	while (start > 0 && mem->cells[start - 1] == 0) {
+		start--;
+	}
+	end = start + st->tag[start];
+	if (end == start || end > mem->size || st->tag[end - 1] != end - start
+			|| pointer + length > end) {
+		return 0;
+	}
+
+	simos_memory_extent_del(st, end - start);
+	if (start < pointer) {
+		simos_memory_extent_add(st, start, pointer - start);
+	}
+	if (pointer + length < end) {
+		simos_memory_extent_add(st, pointer + length,
+				end - pointer - length);
+	}
+
+	return 1;
+}
+
+/**
+ * Account cells [pointer, pointer+length) as free, merging them with the
+ * free extents just before and after. Only cells out of the range are read.
+ */
+void simos_memory_stats_free(simos_memory_t *mem, size_t pointer,
+		size_t length)
+{
+	simos_memory_stats_t *st = mem->stats;
+	size_t start = pointer;
+	size_t end = pointer + length;
+	size_t len;
+
+	if (length == 0) {
+		return;
+	}
+
+	if (start > 0 && mem->cells[start - 1] == 0) {
+		len = st->tag[start - 1];
+		start -= len;
+		simos_memory_extent_del(st, len);
+	}
+	if (end < mem->size && mem->cells[end] == 0) {
+		len = st->tag[end];
+		end += len;
+		simos_memory_extent_del(st, len);
+	}
+
+	simos_memory_extent_add(st, start, end - start);
+}
+
+/** External fragmentation of the memory right now. */
+double simos_memory_fragmentation(simos_memory_t *mem)
+{
+	simos_memory_stats_t *st = mem->stats;
+
+	if (st->free == 0) {
+		return 0.0;
+	}
+
+	return 1.0 - (double) st->largest / st->free;
+}
+
+/** Take a sample whether `interval' units of time elapsed. */
+void simos_memory_stats_sample(simos_memory_t *mem, size_t now)
+{
+	simos_memory_stats_t *st = mem->stats;
+	simos_memory_sample_t *sample;
+
+	if (st->interval == 0 || now < st->next) {
+		return;
+	}
+	st->next = now + st->interval;
+
+	if (st->nsamples == st->maxsamples) {
+		st->maxsamples = st->maxsamples ? 2 * st->maxsamples : 64;
+		st->samples = realloc(st->samples,
+				st->maxsamples * sizeof(simos_memory_sample_t));
+	}
+
+	sample = &st->samples[st->nsamples++];
+	sample->time = now;
+	sample->free = st->free;
+	sample->largest = st->largest;
+	sample->extents = st->extents;
+	sample->fragmentation = simos_memory_fragmentation(mem);
+	memcpy(sample->hist, st->hist, sizeof(st->hist));
+}
+
+/** Forget the samples taken so far. */
+void simos_memory_stats_reset(simos_memory_t *mem)
+{
+	mem->stats->nsamples = 0;
+	mem->stats->next = 0;
+}
+
+/** Write the samples as csv. */
+void simos_memory_stats_write(simos_memory_t *mem, FILE *f)
+{
+	simos_memory_stats_t *st = mem->stats;
+	simos_memory_sample_t *sample;
+	size_t i;
+	int b;
+
+	fprintf(f, "time;free;largest free;free extents;fragmentation");
+	for (b = 0; b < SIMOS_MEMORY_HIST; b++) {
+		fprintf(f, ";<%lu", 2UL << b);
+	}
+	fprintf(f, "\n");
+
+	for (i = 0; i < st->nsamples; i++) {
+		sample = &st->samples[i];
+		fprintf(f, "%d;%d;%d;%d;%.4f", (int) sample->time,
+				(int) sample->free, (int) sample->largest,
+				(int) sample->extents, sample->fragmentation);
+		for (b = 0; b < SIMOS_MEMORY_HIST; b++) {
+			fprintf(f, ";%d", (int) sample->hist[b]);
+		}
+		fprintf(f, "\n");
+	}
+}
+
+/*****************************************************************
+ * Compaction
+ ****************************************************************/
+
+/** Create the state of a compaction moving `budget' bytes each tick. */
+simos_memory_compact_t *simos_memory_compact_create(size_t budget,
+		size_t bandwidth)
+{
+	simos_memory_compact_t *c = malloc(sizeof(simos_memory_compact_t));
+
+	c->budget = budget;
+	c->bandwidth = bandwidth ? bandwidth : 1;
+	c->areas = NULL;
+	c->nareas = 0;
+	c->curr = 0;
+	c->target = 0;
+	c->moved = 0;
+	c->dest = 0;
+	c->running = 0;
+	c->bytes_moved = 0;
+	c->cost = 0;
+	c->pending = 0;
+
+	return c;
+}
+
+void simos_memory_compact_destroy(simos_memory_compact_t *c)
+{
+	free(c->areas);
+	free(c);
+}
+
+/**
+ * Track the blocks and mapped regions of the processes in the list as
+ * live allocations to be relocated.
+ */
+void simos_memory_compact_add(simos_memory_t *mem, simos_list_t *procs)
+{
+	simos_memory_compact_t *c = mem->compact;
+	simos_list_node_t *n;
+	simos_process_t *p;
+	size_t len = 0;
+
+	SIMOS_LIST_FOREACH(n, procs) {
+		len += 2;
+	}
+
+	c->areas = realloc(c->areas,
+			(c->nareas + len) * sizeof(simos_memory_area_t));
+	SIMOS_LIST_FOREACH(n, procs) {
+		p = simos_node_to_process(n);
+		if (p->memory_pointer != (size_t) -1 && p->required_memory) {
+			c->areas[c->nareas].pointer = &p->memory_pointer;
+			c->areas[c->nareas++].length = &p->required_memory;
+		}
+		if (p->mmap_pointer != (size_t) -1 && p->mmap_len) {
+			c->areas[c->nareas].pointer = &p->mmap_pointer;
+			c->areas[c->nareas++].length = &p->mmap_len;
+		}
+	}
+}
+
+static int simos_memory_compact_cmp(const void *a, const void *b)
+{
+	size_t pa = *((simos_memory_area_t *) a)->pointer;
+	size_t pb = *((simos_memory_area_t *) b)->pointer;
+
+	return (pa > pb) - (pa < pb);
+}
+
+/** Start relocating the tracked processes. */
+void simos_memory_compact_start(simos_memory_t *mem)
+{
+	simos_memory_compact_t *c = mem->compact;
+
+	qsort(c->areas, c->nareas, sizeof(simos_memory_area_t),
+			&simos_memory_compact_cmp);
+
+	c->curr = 0;
+	c->moved = 0;
+	c->dest = 0;
+	c->running = 1;
+}
+
+/**
+ * Rebuild the bit map and the list from the cells. A unit of the bit map
+ * is taken whether any of its cells is (allocations start on a unit), the
+ * list gets a block for each run of taken or free cells.
+ */
+void simos_memory_resync(simos_memory_t *mem)
+{
+	simos_list_node_t *n;
+	simos_memory_block_t *b;
+	size_t i, u, start;
+
+	if (mem->bmp) {
+		memset(mem->bmp->map, 0, SIMOS_BMP_SIZE);
+		for (i = 0; i < mem->size; i++) {
+			u = i / mem->bmp->unit;
+			if (mem->cells[i] && u / 8 < SIMOS_BMP_SIZE) {
+				mem->bmp->map[u / 8] |= 1 << (u % 8);
+			}
+		}
+	}
+
+	if (mem->lmem) {
+		while ((n = simos_list_del_head(mem->lmem)) != NULL) {
+			free(n->data);
+			free(n);
+		}
+		for (start = 0, i = 1; i <= mem->size; i++) {
+			if (i == mem->size || !mem->cells[i] != !mem->cells[start]) {
+				b = simos_memory_block_create(start, i - start);
+				b->s = mem->cells[start] ? SIMOS_P : SIMOS_L;
+				simos_memory_list_add(mem->lmem, b);
+				start = i;
+			}
+		}
+	}
+}
+
+/**
+ * Like simos_memory_resync, for the units of the bit map over the range
+ * and the blocks of the list over it or next to it only.
+ */
+void simos_memory_resync_range(simos_memory_t *mem, size_t pointer,
+		size_t length)
+{
+	simos_list_node_t *n, *next, *prev, *first = NULL, *last = NULL;
+	simos_memory_block_t *b;
+	size_t u, i, end, start;
+
+	if (length == 0) {
+		return;
+	}
+
+	if (mem->bmp) {
+		simos_memory_bmp_sync(mem, pointer, length);
+	}
+
+	if (mem->lmem == NULL) {
+		return;
+	}
+
+	/* the blocks over the range and the ones it may merge with */
+	SIMOS_LIST_FOREACH(n, mem->lmem) {
+		b = simos_node_to_memory_block(n);
+		if (b->pointer + b->blocklen < pointer) {
+			continue;
+		}
+		if (b->pointer > pointer + length) {
+			break;
+		}
+		if (first == NULL) {
+			first = n;
+		}
+		last = n;
+	}
+	if (first == NULL) {
+		return;
+	}
+
+	start = simos_node_to_memory_block(first)->pointer;
+	end = simos_node_to_memory_block(last)->pointer
+		+ simos_node_to_memory_block(last)->blocklen;
+	prev = first->prev;
+	next = last->next;
+	for (n = first; n != next; n = first) {
+		first = n->next;
+		free(n->data);
+		free(n);
+	}
+
+	/* in their place, a block for each run of taken or free cells */
+	for (u = start, i = start + 1; i <= end; i++) {
+		if (i == end || !mem->cells[i] != !mem->cells[u]) {
+			b = simos_memory_block_create(u, i - u);
+			b->s = mem->cells[u] ? SIMOS_P : SIMOS_L;
+			n = simos_list_new_node(b);
+			n->prev = prev;
+			n->next = next;
+			if (prev) {
+				prev->next = n;
+			} else {
+				mem->lmem->head = n;
+			}
+			if (next) {
+				next->prev = n;
+			} else {
+				mem->lmem->tail = n;
+			}
+			prev = n;
+			u = i;
+		}
+	}
+}
+
+/**
+ * Relocate at most `budget' bytes. Every area is slided down to the
+ * lowest free cell, in chunks never larger than the gap between source and
+ * destination, so each chunk is a plain bulk move and the freed cells do
+ * not overlap the moved ones. The owner's pointer is updated once the
+ * whole area is in place.
+ *
+ * Return the simulated time spent moving the bytes.
+ */
+size_t simos_memory_compact_step(simos_memory_t *mem)
+{
+	simos_memory_compact_t *c = mem->compact;
+	simos_memory_area_t *a;
+	size_t budget = c->budget;
+	size_t moved = 0;
+	size_t src, len, chunk, cost;
+
+	while (c->running && budget) {
+		if (c->curr == c->nareas) {
+			c->running = 0;
+			simos_memory_resync(mem);
+			c->nareas = 0;
+			break;
+		}
+
+		a = &c->areas[c->curr];
+		src = *a->pointer;
+		len = *a->length;
+
+		if (c->moved == 0) {
+			c->target = c->dest;
+			if (mem->bmp) {
+				/* bit map allocations are unit aligned */
+				c->target += (mem->bmp->unit - c->target % mem->bmp->unit)
+					% mem->bmp->unit;
+			}
+
+			if (c->target >= src) {
+				/* already at the bottom */
+				c->dest = src + len;
+				c->curr++;
+				continue;
+			}
+		}
+
+		chunk = len - c->moved;
+		if (chunk > budget) {
+			chunk = budget;
+		}
+		if (chunk > src - c->target) {
+			chunk = src - c->target;
+		}
+
+		simos_memory_stats_alloc(mem, c->target + c->moved, chunk);
+		memmove(mem->cells + c->target + c->moved,
+				mem->cells + src + c->moved, chunk);
+		memset(mem->cells + src + c->moved, 0, chunk);
+		simos_memory_stats_free(mem, src + c->moved, chunk);
+
+		c->moved += chunk;
+		budget -= chunk;
+		moved += chunk;
+
+		if (c->moved == len) {
+			*a->pointer = c->target;
+			c->dest = c->target + len;
+			c->moved = 0;
+			c->curr++;
+		}
+	}
+
+	c->bytes_moved += moved;
+	c->pending += moved;
+	cost = c->pending / c->bandwidth;
+	c->pending %= c->bandwidth;
+	c->cost += cost;
+
+	return cost;
+}
+
+
+/*****************************************************************
+ * brk and mmap
+ ****************************************************************/
+
+simos_memory_heap_t *simos_memory_heap_create(size_t every, size_t max,
+		size_t bandwidth)
+{
+	simos_memory_heap_t *heap = malloc(sizeof(simos_memory_heap_t));
+
+	heap->every = every;
+	heap->max = max;
+	heap->bandwidth = bandwidth ? bandwidth : 1;
+	heap->resizes = 0;
+	heap->in_place = 0;
+	heap->relocations = 0;
+	heap->failures = 0;
+	heap->bytes_moved = 0;
+	heap->pending = 0;
+
+	return heap;
+}
+
+void simos_memory_heap_destroy(simos_memory_heap_t *heap)
+{
+	free(heap);
+}
+
+/** Whether the cells [pointer, pointer+length) are all free. */
+static int simos_memory_is_free(simos_memory_t *mem, size_t pointer,
+		size_t length)
+{
+	size_t i;
+
+	if (pointer + length > mem->size) {
+		return 0;
+	}
+	for (i = pointer; i < pointer + length; i++) {
+		if (mem->cells[i]) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+size_t simos_memory_resize(simos_memory_t *mem, size_t *pointer,
+		size_t *length, size_t new_length)
+{
+	simos_memory_heap_t *heap = mem->heap;
+	size_t from = *pointer;
+	size_t len = (from == (size_t) -1) ? 0 : *length;
+	size_t to;
+
+	if (heap) {
+		heap->resizes++;
+	}
+
+	if (new_length <= len) {
+		/* the tail goes back to the free cells */
+		simos_memory_free(mem, from + new_length, len - new_length);
+		simos_memory_resync_range(mem, from + new_length, len - new_length);
+		*length = new_length;
+		if (new_length == 0) {
+			*pointer = -1;
+		}
+		return 0;
+	}
+
+	if (len && simos_memory_is_free(mem, from + len, new_length - len)) {
+		/* the cells after the block are the start of a free extent */
+		simos_memory_stats_alloc(mem, from + len, new_length - len);
+		memset(mem->cells + from + len, 1, new_length - len);
+		simos_memory_resync_range(mem, from + len, new_length - len);
+		*length = new_length;
+		if (heap) {
+			heap->in_place++;
+		}
+		return 0;
+	}
+
+	/* elsewhere, keeping the old block until the new one is found */
+	to = p_simos_memory_alloc ? p_simos_memory_alloc(mem, new_length)
+		: simos_memory_alloc(mem, new_length);
+	if (to == (size_t) -1) {
+		if (heap) {
+			heap->failures++;
+		}
+		return -1;
+	}
+
+	simos_memory_resync_range(mem, to, new_length);
+	if (len) {
+		simos_memory_free(mem, from, len);
+		simos_memory_resync_range(mem, from, len);
+	}
+	*pointer = to;
+	*length = new_length;
+	if (heap && len) {
+		heap->relocations++;
+		heap->bytes_moved += len;
+	}
+
+	return len;
+}
+
+size_t simos_memory_brk(simos_memory_t *mem, simos_process_t *proc,
+		size_t length)
+{
+	return simos_memory_resize(mem, &proc->memory_pointer,
+			&proc->required_memory, length);
+}
+
+size_t simos_memory_mmap(simos_memory_t *mem, simos_process_t *proc,
+		size_t length)
+{
+	return simos_memory_resize(mem, &proc->mmap_pointer, &proc->mmap_len,
+			length);
+}
+
+int simos_memory_heap_request(simos_memory_t *mem, simos_process_t *proc,
+		int *map, size_t *len)
+{
+	simos_memory_heap_t *heap = mem->heap;
+	size_t delta;
+	int grow;
+
+	/* relocations wait for the compaction to be over */
+	if (heap->every == 0 || proc->running_time % heap->every
+			|| (mem->compact && mem->compact->running)) {
+		return 0;
+	}
+
+	delta = 1 + rand_r(&proc->seed) % (heap->max / 4 + 1);
+	grow = rand_r(&proc->seed) % 2;
+	*map = ! (rand_r(&proc->seed) % 2);
+
+	if (! *map) {
+		if (proc->memory_pointer == (size_t) -1) {
+			return 0;
+		}
+		*len = proc->required_memory;
+		*len = grow ? *len + delta : (*len > delta ? *len - delta : 1);
+	} else {
+		*len = proc->mmap_len;
+		*len = grow ? *len + delta : (*len > delta ? *len - delta : 0);
+	}
+	if (*len > heap->max) {
+		*len = heap->max;
+	}
+
+	return 1;
+}
+
+size_t simos_memory_heap_resize(simos_memory_t *mem, simos_process_t *proc,
+		int map, size_t len)
+{
+	simos_memory_heap_t *heap = mem->heap;
+	size_t moved, cost;
+
+	moved = map ? simos_memory_mmap(mem, proc, len)
+		: simos_memory_brk(mem, proc, len);
+	if (moved == (size_t) -1) {
+		return 0;
+	}
+
+	heap->pending += moved;
+	cost = heap->pending / heap->bandwidth;
+	heap->pending %= heap->bandwidth;
+
+	return cost;
+}
+
+/** Resize requests of a tick. Return the simulated time spent. */
+size_t simos_memory_heap_tick(simos_memory_t *mem, simos_process_t *proc)
+{
+	size_t len;
+	int map;
+
+	if (! simos_memory_heap_request(mem, proc, &map, &len)) {
+		return 0;
+	}
+	return simos_memory_heap_resize(mem, proc, map, len);
+}
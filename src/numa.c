@@ -0,0 +1,247 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 ljr-ifsp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include "simos.h"
+
+simos_numa_t *simos_numa_create(size_t size, int nnodes, const int *distance,
+		int policy)
+{
+	simos_numa_t *numa = malloc(sizeof(simos_numa_t));
+	int i, j, hops;
+
+	if (nnodes < 1) {
+		nnodes = 1;
+	} else if (nnodes > SIMOS_NUMA_MAX) {
+		nnodes = SIMOS_NUMA_MAX;
+	}
+
+	numa->nnodes = nnodes;
+	for (i = 0; i < nnodes; i++) {
+		numa->node[i].base = size * i / nnodes;
+		numa->node[i].size = size * (i + 1) / nnodes - numa->node[i].base;
+	}
+
+	numa->distance = malloc(nnodes * nnodes * sizeof(int));
+	for (i = 0; i < nnodes; i++) {
+		for (j = 0; j < nnodes; j++) {
+			if (distance) {
+				numa->distance[i * nnodes + j] = distance[i * nnodes + j];
+				continue;
+			}
+			hops = abs(i - j);
+			if (hops > nnodes - hops) {
+				hops = nnodes - hops;
+			}
+			numa->distance[i * nnodes + j] = hops ? 10 + 11 * hops
+				: SIMOS_NUMA_NEAR;
+		}
+	}
+
+	numa->policy = policy;
+	numa->next_mem = 0;
+	numa->memory_bound = 30;
+	numa->pending = 0;
+
+	for (i = 0; i < nnodes; i++) {
+		numa->node[i].load = 0;
+		numa->node[i].allocs = 0;
+		numa->node[i].fallbacks = 0;
+		numa->node[i].failures = 0;
+	}
+	simos_numa_reset(numa);
+	return numa;
+}
+
+void simos_numa_destroy(simos_numa_t *numa)
+{
+	free(numa->distance);
+	free(numa);
+}
+
+int simos_numa_node_of(simos_numa_t *numa, size_t pointer)
+{
+	int i;
+
+	for (i = 0; i < numa->nnodes; i++) {
+		if (pointer - numa->node[i].base < numa->node[i].size) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+int simos_numa_distance(simos_numa_t *numa, int from, int to)
+{
+	return numa->distance[from * numa->nnodes + to];
+}
+
+/** First fit of `len' cells on the node, -1 if none. */
+static size_t simos_numa_fit(simos_memory_t *mem, simos_numa_node_t *node,
+		size_t len)
+{
+	size_t unit = mem->bmp ? mem->bmp->unit : 1;
+	size_t i, start = 0, run = 0;
+
+	for (i = node->base; i < node->base + node->size; i++) {
+		if (mem->cells[i]) {
+			run = 0;
+			continue;
+		}
+		if (run == 0) {
+			if (i % unit) {
+				continue;
+			}
+			start = i;
+		}
+		if (++run == len) {
+			if (allocator(mem, start, len) == (size_t) -1) {
+				return -1;
+			}
+			simos_memory_resync_range(mem, start, len);
+			return start;
+		}
+	}
+	return -1;
+}
+
+size_t simos_numa_alloc(simos_numa_t *numa, simos_memory_t *mem,
+		simos_process_t *proc, size_t len)
+{
+	int order[SIMOS_NUMA_MAX], first, i, j, tmp;
+	size_t pointer;
+
+	if (proc->numa_node < 0) {
+		/* the CPUs with the least work to do */
+		proc->numa_node = 0;
+		for (i = 1; i < numa->nnodes; i++) {
+			if (numa->node[i].load < numa->node[proc->numa_node].load) {
+				proc->numa_node = i;
+			}
+		}
+		numa->node[proc->numa_node].load += proc->required_execution_time;
+	}
+
+	if (numa->policy == SIMOS_NUMA_INTERLEAVE) {
+		first = numa->next_mem;
+		numa->next_mem = (numa->next_mem + 1) % numa->nnodes;
+	} else {
+		first = proc->numa_node;
+	}
+	numa->node[first].allocs++;
+
+	pointer = simos_numa_fit(mem, &numa->node[first], len);
+	if (pointer != (size_t) -1 || numa->policy == SIMOS_NUMA_BIND) {
+		if (pointer == (size_t) -1) {
+			numa->node[first].failures++;
+		}
+		return pointer;
+	}
+
+	/* the other nodes, nearest to the process first */
+	for (i = 0; i < numa->nnodes; i++) {
+		order[i] = i;
+		for (j = i; j > 0 && simos_numa_distance(numa, proc->numa_node,
+					order[j - 1]) > simos_numa_distance(numa,
+						proc->numa_node, order[j]); j--) {
+			tmp = order[j];
+			order[j] = order[j - 1];
+			order[j - 1] = tmp;
+		}
+	}
+
+	for (i = 0; i < numa->nnodes; i++) {
+		if (order[i] == first) {
+			continue;
+		}
+		pointer = simos_numa_fit(mem, &numa->node[order[i]], len);
+		if (pointer != (size_t) -1) {
+			numa->node[first].fallbacks++;
+			return pointer;
+		}
+	}
+
+	numa->node[first].failures++;
+	return -1;
+}
+
+size_t simos_numa_used(simos_numa_t *numa, simos_memory_t *mem, int node)
+{
+	size_t i, used = 0;
+
+	for (i = numa->node[node].base;
+			i < numa->node[node].base + numa->node[node].size; i++) {
+		used += mem->cells[i] != 0;
+	}
+	return used;
+}
+
+size_t simos_numa_tick(simos_numa_t *numa, simos_process_t *proc)
+{
+	size_t len = 0, cost = 0, d;
+
+	if (proc->numa_node < 0) {
+		return 0;
+	}
+
+	/* the accesses go to the block and the region, as large as they are */
+	if (proc->memory_pointer != (size_t) -1) {
+		d = simos_numa_distance(numa, proc->numa_node,
+				simos_numa_node_of(numa, proc->memory_pointer));
+		cost += (d - SIMOS_NUMA_NEAR) * proc->required_memory;
+		len += proc->required_memory;
+	}
+	if (proc->mmap_pointer != (size_t) -1) {
+		d = simos_numa_distance(numa, proc->numa_node,
+				simos_numa_node_of(numa, proc->mmap_pointer));
+		cost += (d - SIMOS_NUMA_NEAR) * proc->mmap_len;
+		len += proc->mmap_len;
+	}
+	if (len == 0) {
+		return 0;
+	}
+
+	if (cost == 0) {
+		numa->local++;
+		return 0;
+	}
+	numa->remote++;
+
+	/* memory_bound% of the tick, (d - near) / near slower */
+	numa->pending += cost * numa->memory_bound * 1000
+		/ (len * SIMOS_NUMA_NEAR * 100);
+	cost = numa->pending / 1000;
+	numa->pending %= 1000;
+	numa->cost += cost;
+
+	return cost;
+}
+
+void simos_numa_reset(simos_numa_t *numa)
+{
+	numa->local = 0;
+	numa->remote = 0;
+	numa->cost = 0;
+	numa->pending = 0;
+}
@@ -0,0 +1,608 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 ljr-ifsp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <malloc.h>
+#include "simos.h"
+
+/* ARC lists a page may be in. */
+#define SIMOS_ARC_NONE 0
+#define SIMOS_ARC_T1 1
+#define SIMOS_ARC_T2 2
+#define SIMOS_ARC_B1 3
+#define SIMOS_ARC_B2 4
+
+#define SIMOS_FRAME(l) \
+	((simos_frame_t *) ((char *) (l) - offsetof(simos_frame_t, link)))
+#define SIMOS_GHOST(l) \
+	((simos_pte_t *) ((char *) (l) - offsetof(simos_pte_t, ghost)))
+
+
+/*****************************************************************
+ * Intrusive lists: every operation is O(1)
+ ****************************************************************/
+static void simos_page_list_init(simos_page_list_t *list)
+{
+	list->head.prev = list->head.next = &list->head;
+	list->len = 0;
+}
+
+/** Add at tail (most recently used). */
+static void simos_page_list_add(simos_page_list_t *list,
+		simos_page_link_t *link)
+{
+	link->prev = list->head.prev;
+	link->next = &list->head;
+	list->head.prev->next = link;
+	list->head.prev = link;
+	list->len++;
+}
+
+static void simos_page_list_del(simos_page_list_t *list,
+		simos_page_link_t *link)
+{
+	link->prev->next = link->next;
+	link->next->prev = link->prev;
+	link->prev = link->next = link;
+	list->len--;
+}
+
+/** Delete and return the head (least recently used), NULL if empty. */
+static simos_page_link_t *simos_page_list_del_head(simos_page_list_t *list)
+{
+	simos_page_link_t *link = list->head.next;
+
+	if (link == &list->head) {
+		return NULL;
+	}
+	simos_page_list_del(list, link);
+
+	return link;
+}
+
+
+/*****************************************************************
+ * TLB
+ ****************************************************************/
+static simos_tlb_entry_t *simos_tlb_slot(simos_paging_t *pg, int pid,
+		size_t vpn)
+{
+	return &pg->tlb[(vpn * 2654435761u ^ pid) % pg->tlb_size];
+}
+
+static void simos_tlb_invalidate(simos_paging_t *pg, simos_pte_t *pte)
+{
+	simos_tlb_entry_t *e = simos_tlb_slot(pg, pte->pid, pte->vpn);
+
+	if (e->valid && e->pid == pte->pid && e->vpn == pte->vpn) {
+		e->valid = 0;
+	}
+}
+
+
+/*****************************************************************
+ * Frames
+ ****************************************************************/
+
+/** Carve the memory into frames of `page_size' cells. */
+simos_paging_t *simos_paging_create(simos_memory_t *mem, size_t page_size,
+		int policy, size_t tlb_size)
+{
+	simos_paging_t *pg = malloc(sizeof(simos_paging_t));
+	size_t f;
+
+	pg->mem = mem;
+	pg->policy = policy;
+	pg->page_size = page_size;
+	pg->nframes = mem->size / page_size;
+	pg->frames = calloc(pg->nframes, sizeof(simos_frame_t));
+
+	simos_page_list_init(&pg->free);
+	simos_page_list_init(&pg->t1);
+	simos_page_list_init(&pg->t2);
+	simos_page_list_init(&pg->b1);
+	simos_page_list_init(&pg->b2);
+	for (f = 0; f < pg->nframes; f++) {
+		simos_page_list_add(&pg->free, &pg->frames[f].link);
+	}
+	pg->arc_p = 0;
+	pg->hand = 0;
+
+	pg->tlb_size = tlb_size ? tlb_size : 1;
+	pg->tlb = calloc(pg->tlb_size, sizeof(simos_tlb_entry_t));
+
+	pg->refs_per_tick = 10;
+	pg->locality = 90;
+	pg->writes = 30;
+
+	pg->tlb_miss_cost = 20;
+	pg->fault_cost = 5000;
+	pg->writeback_cost = 5000;
+	pg->copy_cost = 1000;
+	pg->cycles_per_tick = 1000;
+	pg->cycles = 0;
+
+	pg->accesses = 0;
+	pg->tlb_misses = 0;
+	pg->faults = 0;
+	pg->evictions = 0;
+	pg->cow_copies = 0;
+
+	return pg;
+}
+
+void simos_paging_destroy(simos_paging_t *pg)
+{
+	free(pg->frames);
+	free(pg->tlb);
+	free(pg);
+}
+
+static size_t simos_frame_index(simos_paging_t *pg, simos_frame_t *frame)
+{
+	return frame - pg->frames;
+}
+
+/** Map the page in the frame, the cells of the frame become used. */
+static void simos_frame_map(simos_paging_t *pg, simos_frame_t *frame,
+		simos_pte_t *pte)
+{
+	size_t f = simos_frame_index(pg, frame);
+
+	frame->pte = pte;
+	frame->mapcount = 1;
+	pte->rmap_next = NULL;
+	pte->frame = f;
+	pte->present = 1;
+	pte->dirty = 0;
+	pte->cow = 0;
+
+	simos_memory_stats_alloc(pg->mem, f * pg->page_size, pg->page_size);
+	memset(pg->mem->cells + f * pg->page_size, 1, pg->page_size);
+}
+
+/**
+ * Unmap every page in the frame, writing it back whether dirty. The
+ * first page keeps its ARC state, the others forget it.
+ */
+static size_t simos_frame_unmap(simos_paging_t *pg, simos_frame_t *frame)
+{
+	simos_pte_t *pte, *next;
+	size_t f = simos_frame_index(pg, frame);
+	size_t cycles = 0;
+	int dirty = 0;
+
+	for (pte = frame->pte; pte; pte = next) {
+		next = pte->rmap_next;
+		dirty |= pte->dirty;
+		pte->present = 0;
+		pte->referenced = 0;
+		pte->dirty = 0;
+		pte->cow = 0;
+		pte->rmap_next = NULL;
+		if (pte != frame->pte) {
+			pte->arc = SIMOS_ARC_NONE;
+		}
+		simos_tlb_invalidate(pg, pte);
+	}
+	if (dirty) {
+		cycles += pg->writeback_cost;
+	}
+	frame->pte = NULL;
+	frame->mapcount = 0;
+
+	memset(pg->mem->cells + f * pg->page_size, 0, pg->page_size);
+	simos_memory_stats_free(pg->mem, f * pg->page_size, pg->page_size);
+
+	return cycles;
+}
+
+/**
+ * Take the page out of a frame other pages still map. Whether it was the
+ * first one, the next inherits the replacement state and the dirty bit.
+ */
+static void simos_frame_unshare(simos_paging_t *pg, simos_pte_t *pte)
+{
+	simos_frame_t *frame = &pg->frames[pte->frame];
+	simos_pte_t **link;
+
+	for (link = &frame->pte; *link != pte; link = &(*link)->rmap_next);
+	*link = pte->rmap_next;
+	frame->mapcount--;
+
+	if (link == &frame->pte) {
+		frame->pte->arc = pte->arc;
+		frame->pte->referenced |= pte->referenced;
+	}
+	frame->pte->dirty |= pte->dirty;
+
+	pte->rmap_next = NULL;
+	pte->present = 0;
+	pte->referenced = 0;
+	pte->dirty = 0;
+	pte->cow = 0;
+	pte->arc = SIMOS_ARC_NONE;
+	simos_tlb_invalidate(pg, pte);
+}
+
+
+/*****************************************************************
+ * Replacement policies: victim selection is O(1), CLOCK amortized
+ ****************************************************************/
+
+/** ARC's REPLACE: evict T1's or T2's LRU page into the ghost lists. */
+static simos_frame_t *simos_arc_replace(simos_paging_t *pg, int in_b2)
+{
+	simos_page_link_t *l;
+	simos_pte_t *pte;
+
+	if (pg->t1.len && (pg->t1.len > pg->arc_p
+			|| (in_b2 && pg->t1.len == pg->arc_p) || pg->t2.len == 0)) {
+		l = simos_page_list_del_head(&pg->t1);
+		pte = SIMOS_FRAME(l)->pte;
+		pte->arc = SIMOS_ARC_B1;
+		simos_page_list_add(&pg->b1, &pte->ghost);
+	} else {
+		l = simos_page_list_del_head(&pg->t2);
+		pte = SIMOS_FRAME(l)->pte;
+		pte->arc = SIMOS_ARC_B2;
+		simos_page_list_add(&pg->b2, &pte->ghost);
+	}
+
+	return SIMOS_FRAME(l);
+}
+
+static void simos_arc_drop_ghost(simos_page_list_t *list)
+{
+	simos_page_link_t *l = simos_page_list_del_head(list);
+
+	if (l) {
+		SIMOS_GHOST(l)->arc = SIMOS_ARC_NONE;
+	}
+}
+
+/** Pick the frame whose page is going to leave. */
+static simos_frame_t *simos_paging_victim(simos_paging_t *pg, int in_b2)
+{
+	simos_frame_t *frame;
+
+	switch (pg->policy) {
+		case SIMOS_PAGE_CLOCK:
+			while (1) {
+				frame = &pg->frames[pg->hand];
+				pg->hand = (pg->hand + 1) % pg->nframes;
+				if (! frame->pte->referenced) {
+					return frame;
+				}
+				frame->pte->referenced = 0;
+			}
+		case SIMOS_PAGE_ARC:
+			return simos_arc_replace(pg, in_b2);
+		default: // FIFO and LRU, the queue order differs on hits
+			return SIMOS_FRAME(simos_page_list_del_head(&pg->t1));
+	}
+}
+
+/** Bring the page in a frame, evicting another one whether needed. */
+static size_t simos_paging_load(simos_paging_t *pg, simos_pte_t *pte)
+{
+	simos_page_link_t *l;
+	simos_frame_t *frame;
+	size_t c = pg->nframes;
+	size_t cycles = 0;
+	size_t delta;
+	int ghost = pte->arc;
+
+	if (pg->policy == SIMOS_PAGE_ARC) {
+		if (ghost == SIMOS_ARC_B1) {
+			/* recency is winning: grow T1's target */
+			pg->arc_p += pg->b2.len > pg->b1.len
+				? pg->b2.len / pg->b1.len : 1;
+			if (pg->arc_p > c) {
+				pg->arc_p = c;
+			}
+			simos_page_list_del(&pg->b1, &pte->ghost);
+		} else if (ghost == SIMOS_ARC_B2) {
+			/* frequency is winning: shrink T1's target */
+			delta = pg->b1.len > pg->b2.len ? pg->b1.len / pg->b2.len : 1;
+			pg->arc_p -= pg->arc_p < delta ? pg->arc_p : delta;
+			simos_page_list_del(&pg->b2, &pte->ghost);
+		} else if (pg->t1.len + pg->b1.len == c) {
+			if (pg->t1.len < c) {
+				simos_arc_drop_ghost(&pg->b1);
+			} else {
+				/* B1 is empty: T1's LRU leaves without a ghost */
+				frame = SIMOS_FRAME(simos_page_list_del_head(&pg->t1));
+				frame->pte->arc = SIMOS_ARC_NONE;
+				cycles += simos_frame_unmap(pg, frame);
+				pg->evictions++;
+				simos_page_list_add(&pg->free, &frame->link);
+			}
+		} else if (pg->t1.len + pg->t2.len
+				+ pg->b1.len + pg->b2.len >= 2 * c) {
+			simos_arc_drop_ghost(&pg->b2);
+		}
+	}
+
+	l = simos_page_list_del_head(&pg->free);
+	if (l) {
+		frame = SIMOS_FRAME(l);
+	} else {
+		frame = simos_paging_victim(pg, ghost == SIMOS_ARC_B2);
+		cycles += simos_frame_unmap(pg, frame);
+		pg->evictions++;
+	}
+	simos_frame_map(pg, frame, pte);
+
+	switch (pg->policy) {
+		case SIMOS_PAGE_CLOCK:
+			break;
+		case SIMOS_PAGE_ARC:
+			if (ghost == SIMOS_ARC_B1 || ghost == SIMOS_ARC_B2) {
+				pte->arc = SIMOS_ARC_T2;
+				simos_page_list_add(&pg->t2, &frame->link);
+			} else {
+				pte->arc = SIMOS_ARC_T1;
+				simos_page_list_add(&pg->t1, &frame->link);
+			}
+			break;
+		default:
+			simos_page_list_add(&pg->t1, &frame->link);
+	}
+
+	return cycles;
+}
+
+/** A resident page was referenced. */
+static void simos_paging_hit(simos_paging_t *pg, simos_pte_t *pte)
+{
+	simos_frame_t *frame = &pg->frames[pte->frame];
+
+	pte = frame->pte; // the state of a shared frame is in its first page
+
+	switch (pg->policy) {
+		case SIMOS_PAGE_LRU:
+			simos_page_list_del(&pg->t1, &frame->link);
+			simos_page_list_add(&pg->t1, &frame->link);
+			break;
+		case SIMOS_PAGE_ARC:
+			simos_page_list_del(pte->arc == SIMOS_ARC_T1 ? &pg->t1 : &pg->t2,
+					&frame->link);
+			pte->arc = SIMOS_ARC_T2;
+			simos_page_list_add(&pg->t2, &frame->link);
+			break;
+	}
+}
+
+
+/*****************************************************************
+ * Processes
+ ****************************************************************/
+
+/** Create the (empty) page table of the process. */
+void simos_paging_add_process(simos_paging_t *pg, simos_process_t *proc)
+{
+	simos_page_table_t *pt = malloc(sizeof(simos_page_table_t));
+	size_t vpn;
+
+	pt->npages = (proc->required_memory + pg->page_size - 1) / pg->page_size;
+	if (pt->npages == 0) {
+		pt->npages = 1;
+	}
+	pt->last = 0;
+	pt->pte = calloc(pt->npages, sizeof(simos_pte_t));
+	for (vpn = 0; vpn < pt->npages; vpn++) {
+		pt->pte[vpn].pid = proc->pid;
+		pt->pte[vpn].vpn = vpn;
+		pt->pte[vpn].arc = SIMOS_ARC_NONE;
+	}
+
+	proc->pt = pt;
+}
+
+/** Give back frames and page table of the process. */
+void simos_paging_release(simos_paging_t *pg, simos_process_t *proc)
+{
+	simos_page_table_t *pt = proc->pt;
+	simos_frame_t *frame;
+	simos_pte_t *pte;
+	size_t vpn;
+
+	if (pt == NULL) {
+		return;
+	}
+
+	for (vpn = 0; vpn < pt->npages; vpn++) {
+		pte = &pt->pte[vpn];
+		if (pte->present && pg->frames[pte->frame].mapcount > 1) {
+			/* the others keep the frame */
+			simos_frame_unshare(pg, pte);
+		} else if (pte->present) {
+			frame = &pg->frames[pte->frame];
+			if (pte->arc == SIMOS_ARC_T2) {
+				simos_page_list_del(&pg->t2, &frame->link);
+			} else if (pg->policy != SIMOS_PAGE_CLOCK) {
+				simos_page_list_del(&pg->t1, &frame->link);
+			}
+			pte->dirty = 0; // nothing to write back
+			simos_frame_unmap(pg, frame);
+			simos_page_list_add(&pg->free, &frame->link);
+		} else if (pte->arc == SIMOS_ARC_B1) {
+			simos_page_list_del(&pg->b1, &pte->ghost);
+		} else if (pte->arc == SIMOS_ARC_B2) {
+			simos_page_list_del(&pg->b2, &pte->ghost);
+		}
+	}
+
+	free(pt->pte);
+	free(pt);
+	proc->pt = NULL;
+}
+
+void simos_paging_fork(simos_paging_t *pg, simos_process_t *parent,
+		simos_process_t *child)
+{
+	simos_page_table_t *pt = malloc(sizeof(simos_page_table_t));
+	simos_pte_t *from, *pte;
+	simos_frame_t *frame;
+	size_t vpn;
+
+	pt->npages = parent->pt->npages;
+	pt->last = parent->pt->last;
+	pt->pte = calloc(pt->npages, sizeof(simos_pte_t));
+	for (vpn = 0; vpn < pt->npages; vpn++) {
+		pte = &pt->pte[vpn];
+		pte->pid = child->pid;
+		pte->vpn = vpn;
+		pte->arc = SIMOS_ARC_NONE;
+
+		from = &parent->pt->pte[vpn];
+		if (! from->present) {
+			continue;
+		}
+
+		/* right after the first page, which keeps the frame's state */
+		frame = &pg->frames[from->frame];
+		pte->frame = from->frame;
+		pte->present = 1;
+		pte->rmap_next = frame->pte->rmap_next;
+		frame->pte->rmap_next = pte;
+		frame->mapcount++;
+		pte->cow = 1;
+		from->cow = 1;
+	}
+
+	child->pt = pt;
+}
+
+/** Write to a page shared since a fork: copy it, unless nobody else is left. */
+static size_t simos_paging_cow(simos_paging_t *pg, simos_pte_t *pte)
+{
+	pte->cow = 0;
+	if (pg->frames[pte->frame].mapcount == 1) {
+		return 0;
+	}
+
+	/* the copy takes a frame like a fault, the cells are all alike */
+	simos_frame_unshare(pg, pte);
+	pg->cow_copies++;
+
+	return pg->copy_cost + simos_paging_load(pg, pte);
+}
+
+void simos_paging_footprint(simos_paging_t *pg, simos_process_t *proc,
+		size_t *resident, size_t *shared)
+{
+	simos_page_table_t *pt = proc->pt;
+	size_t vpn;
+
+	*resident = *shared = 0;
+	for (vpn = 0; pt && vpn < pt->npages; vpn++) {
+		if (pt->pte[vpn].present) {
+			(*resident)++;
+			if (pg->frames[pt->pte[vpn].frame].mapcount > 1) {
+				(*shared)++;
+			}
+		}
+	}
+}
+
+/**
+ * Next page of the process' reference string: most references stay close
+ * to the last page (locality), the others jump anywhere.
+ */
+size_t simos_paging_reference(simos_paging_t *pg, simos_process_t *proc)
+{
+	simos_page_table_t *pt = proc->pt;
+
+	if ((size_t) (rand_r(&proc->seed) % 100) < pg->locality) {
+		pt->last = (pt->last + pt->npages - 1
+				+ rand_r(&proc->seed) % 3) % pt->npages;
+	} else {
+		pt->last = rand_r(&proc->seed) % pt->npages;
+	}
+
+	return pt->last;
+}
+
+/** Access a page. Return the cycles spent in TLB misses and faults. */
+size_t simos_paging_access(simos_paging_t *pg, simos_process_t *proc,
+		size_t vpn, int write)
+{
+	simos_pte_t *pte = &proc->pt->pte[vpn];
+	simos_tlb_entry_t *e = simos_tlb_slot(pg, proc->pid, vpn);
+	size_t cycles = 0;
+
+	pg->accesses++;
+
+	if (write && pte->present && pte->cow) {
+		cycles += simos_paging_cow(pg, pte);
+	}
+
+	if (! (e->valid && e->pid == proc->pid && e->vpn == vpn)) {
+		pg->tlb_misses++;
+		cycles += pg->tlb_miss_cost;
+
+		if (pte->present) {
+			simos_paging_hit(pg, pte);
+		} else {
+			pg->faults++;
+			proc->page_faults++;
+			cycles += pg->fault_cost;
+			cycles += simos_paging_load(pg, pte);
+		}
+
+		e->pid = proc->pid;
+		e->vpn = vpn;
+		e->frame = pte->frame;
+		e->valid = 1;
+	} else {
+		simos_paging_hit(pg, pte);
+	}
+
+	pg->frames[pte->frame].pte->referenced = 1;
+	if (write) {
+		pte->dirty = 1;
+	}
+
+	return cycles;
+}
+
+/** Run the references of a tick. Return the simulated time spent. */
+size_t simos_paging_tick(simos_paging_t *pg, simos_process_t *proc)
+{
+	size_t i, vpn, cost;
+	int write;
+
+	for (i = 0; i < pg->refs_per_tick; i++) {
+		vpn = simos_paging_reference(pg, proc);
+		write = (size_t) (rand_r(&proc->seed) % 100) < pg->writes;
+		pg->cycles += simos_paging_access(pg, proc, vpn, write);
+	}
+
+	cost = pg->cycles / pg->cycles_per_tick;
+	pg->cycles %= pg->cycles_per_tick;
+
+	return cost;
+}
@@ -20,6 +20,7 @@
  * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
  * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
+#include <stdlib.h>
 #include <malloc.h>
 #include "simos.h"
 
@@ -34,21 +35,132 @@ simos_process_t *simos_process_create(int pid, size_t required_execution_time,
 	proc->required_memory = required_memory;
 	proc->turnaround_time = required_execution_time;
 	proc->memory_pointer = -1;
+	proc->mmap_pointer = -1;
+	proc->mmap_len = 0;
 
 	//used by shcedule
 	proc->quantum = 1;
 	proc->priority = 0;
 	proc->running_time = 0;
-	
+
+	//used by paging
+	proc->pt = NULL;
+	proc->seed = pid + 1;
+	proc->page_faults = 0;
+
+	//used by cache
+	proc->address = 0;
+	proc->cache_misses = 0;
+
+	proc->last_run = 0;
+	proc->switches = 0;
+	proc->switch_time = 0;
+
+	proc->arrival_time = 0;
+	proc->vruntime = 0;
+	proc->tickets = 100;
+	proc->pass = 0;
+	proc->aging_key = 0;
+
+	proc->period = 0;
+	proc->deadline = 0;
+	proc->wcet = 0;
+	proc->sporadic = 0;
+	proc->release = 0;
+	proc->abs_deadline = 0;
+	proc->job_left = 0;
+	proc->jobs = 0;
+	proc->deadline_misses = 0;
+
+	//until a burst is seen, guess the average job of the examples
+	proc->burst_estimate = 275;
+	proc->bursts = 0;
+
+	//no I/O
+	proc->cpu_burst = 0;
+	proc->io_burst = 0;
+	proc->device = 0;
+	proc->sector = 0;
+	proc->file = -1;
+	proc->file_offset = 0;
+
+	proc->waiting_on = NULL;
+	proc->held = NULL;
+	proc->base_priority = 0;
+	proc->sync_time = 0;
+	proc->lock = NULL;
+	proc->cs_every = 0;
+	proc->cs_len = 0;
+	proc->cs_left = 0;
+	proc->ipc_in = NULL;
+	proc->ipc_out = NULL;
+	proc->ipc_every = 0;
+	proc->ipc_size = 0;
+	proc->ipc_phase = 0;
+	proc->ipc_data = NULL;
+	proc->ipc_left = 0;
+	proc->ipc_done = 0;
+	proc->bank_row = -1;
+	proc->swap_slot = -1;
+	proc->swap_req = NULL;
+	proc->swap_time = 0;
+	proc->numa_node = -1;
+	proc->group = NULL;
+	proc->state = SIMOS_READY;
+	proc->burst_left = 0;
+	proc->burst_start = 0;
+	proc->io_time = 0;
+	proc->leader = proc;
+	proc->nthreads = 1;
+	proc->threads_time = 0;
+	proc->done_time = 0;
+	proc->energy = 0;
+
 	return proc;
 }
 
+/** New thread of `leader', sharing its address space. */
+simos_process_t *simos_thread_create(simos_process_t *leader, int tid,
+		size_t required_execution_time)
+{
+	simos_process_t *t = simos_process_create(tid, required_execution_time, 0);
+
+	t->leader = leader;
+	t->group = leader->group;
+	t->numa_node = leader->numa_node;
+	leader->nthreads++;
+
+	return t;
+}
+
 /** Just call free (malloc(3)) in proc. */
 void simos_process_destroy(simos_process_t *proc)
 {
 	free(proc);
 }
 
+/** Update the predicted CPU burst by exponential averaging. */
+void simos_process_burst(simos_process_t *proc, size_t burst, int alpha)
+{
+	if (proc->bursts == 0) {
+		proc->burst_estimate = burst;
+	} else {
+		proc->burst_estimate = (alpha * burst
+				+ (100 - alpha) * proc->burst_estimate) / 100;
+	}
+	proc->bursts++;
+}
+
+/** Uniform length in 1..2*mean, 0 if mean is 0. */
+size_t simos_process_draw(simos_process_t *proc, size_t mean)
+{
+	if (mean == 0) {
+		return 0;
+	}
+
+	return 1 + rand_r(&proc->seed) % (2 * mean);
+}
+
 /** Type cast in node->data to simos_process_t. */
 simos_process_t *simos_node_to_process(simos_list_node_t *node)
 {
@@ -0,0 +1,382 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 ljr-ifsp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <malloc.h>
+#include "simos.h"
+
+/**
+ * Allocate room for a tree.
+ */
+simos_rb_tree_t *simos_rb_new()
+{
+	simos_rb_tree_t *t = malloc(sizeof(simos_rb_tree_t));
+
+	t->root = NULL;
+	t->first = NULL;
+	t->len = 0;
+
+	return t;
+}
+
+/**
+ * Create a new tree node from data, ordered by key.
+ */
+simos_rb_node_t *simos_rb_new_node(void *data, size_t key)
+{
+	simos_rb_node_t *n = malloc(sizeof(simos_rb_node_t));
+
+	n->data = data;
+	n->key = key;
+	n->left = n->right = n->parent = NULL;
+	n->red = 0;
+
+	return n;
+}
+
+/**
+ * Is the tree empty?
+ */
+int simos_rb_empty(simos_rb_tree_t *tree)
+{
+	return tree->root == NULL;
+}
+
+static void simos_rb_rotate_left(simos_rb_tree_t *tree, simos_rb_node_t *x)
+{
+	simos_rb_node_t *y = x->right;
+
+	x->right = y->left;
+	if (y->left) {
+		y->left->parent = x;
+	}
+	y->parent = x->parent;
+	if (x->parent == NULL) {
+		tree->root = y;
+	} else if (x == x->parent->left) {
+		x->parent->left = y;
+	} else {
+		x->parent->right = y;
+	}
+	y->left = x;
+	x->parent = y;
+}
+
+static void simos_rb_rotate_right(simos_rb_tree_t *tree, simos_rb_node_t *x)
+{
+	simos_rb_node_t *y = x->left;
+
+	x->left = y->right;
+	if (y->right) {
+		y->right->parent = x;
+	}
+	y->parent = x->parent;
+	if (x->parent == NULL) {
+		tree->root = y;
+	} else if (x == x->parent->right) {
+		x->parent->right = y;
+	} else {
+		x->parent->left = y;
+	}
+	y->right = x;
+	x->parent = y;
+}
+
+/**
+ * Insert the node. Nodes with the same key keep the insertion order.
+ */
+void simos_rb_insert(simos_rb_tree_t *tree, simos_rb_node_t *node)
+{
+	simos_rb_node_t *parent = NULL;
+	simos_rb_node_t **link = &tree->root;
+	simos_rb_node_t *uncle;
+	int leftmost = 1;
+
+	while (*link) {
+		parent = *link;
+		if (node->key < parent->key) {
+			link = &parent->left;
+		} else {
+			link = &parent->right;
+			leftmost = 0;
+		}
+	}
+
+	node->parent = parent;
+	node->left = node->right = NULL;
+	node->red = 1;
+	*link = node;
+	tree->len++;
+	if (leftmost) {
+		tree->first = node;
+	}
+
+	/* fix the colors from the node up */
+	while ((parent = node->parent) && parent->red) {
+		if (parent == parent->parent->left) {
+			uncle = parent->parent->right;
+			if (uncle && uncle->red) {
+				parent->red = uncle->red = 0;
+				parent->parent->red = 1;
+				node = parent->parent;
+				continue;
+			}
+			if (node == parent->right) {
+				simos_rb_rotate_left(tree, parent);
+				node = parent;
+				parent = node->parent;
+			}
+			parent->red = 0;
+			parent->parent->red = 1;
+			simos_rb_rotate_right(tree, parent->parent);
+		} else {
+			uncle = parent->parent->left;
+			if (uncle && uncle->red) {
+				parent->red = uncle->red = 0;
+				parent->parent->red = 1;
+				node = parent->parent;
+				continue;
+			}
+			if (node == parent->left) {
+				simos_rb_rotate_right(tree, parent);
+				node = parent;
+				parent = node->parent;
+			}
+			parent->red = 0;
+			parent->parent->red = 1;
+			simos_rb_rotate_left(tree, parent->parent);
+		}
+	}
+	tree->root->red = 0;
+}
+
+/** Put `v' in the place of `u'. */
+static void simos_rb_transplant(simos_rb_tree_t *tree, simos_rb_node_t *u,
+		simos_rb_node_t *v)
+{
+	if (u->parent == NULL) {
+		tree->root = v;
+	} else if (u == u->parent->left) {
+		u->parent->left = v;
+	} else {
+		u->parent->right = v;
+	}
+	if (v) {
+		v->parent = u->parent;
+	}
+}
+
+/**
+ * Delete the node from the tree. The node itself is not freed.
+ */
+void simos_rb_del(simos_rb_tree_t *tree, simos_rb_node_t *node)
+{
+	simos_rb_node_t *y = node, *x, *xparent, *w;
+	int red = y->red;
+
+	if (node == tree->first) {
+		tree->first = simos_rb_next(node);
+	}
+
+	if (node->left == NULL) {
+		x = node->right;
+		xparent = node->parent;
+		simos_rb_transplant(tree, node, x);
+	} else if (node->right == NULL) {
+		x = node->left;
+		xparent = node->parent;
+		simos_rb_transplant(tree, node, x);
+	} else {
+		y = node->right;
+		while (y->left) {
+			y = y->left;
+		}
+		red = y->red;
+		x = y->right;
+		if (y->parent == node) {
+			xparent = y;
+		} else {
+			xparent = y->parent;
+			simos_rb_transplant(tree, y, y->right);
+			y->right = node->right;
+			y->right->parent = y;
+		}
+		simos_rb_transplant(tree, node, y);
+		y->left = node->left;
+		y->left->parent = y;
+		y->red = node->red;
+	}
+	tree->len--;
+	node->left = node->right = node->parent = NULL;
+
+	if (red) {
+		return;
+	}
+
+	/* a black node is gone: fix the colors from x up */
+	while (x != tree->root && (x == NULL || ! x->red)) {
+		if (x == xparent->left) {
+			w = xparent->right;
+			if (w->red) {
+				w->red = 0;
+				xparent->red = 1;
+				simos_rb_rotate_left(tree, xparent);
+				w = xparent->right;
+			}
+			if ((w->left == NULL || ! w->left->red)
+					&& (w->right == NULL || ! w->right->red)) {
+				w->red = 1;
+				x = xparent;
+				xparent = x->parent;
+			} else {
+				if (w->right == NULL || ! w->right->red) {
+					w->left->red = 0;
+					w->red = 1;
+					simos_rb_rotate_right(tree, w);
+					w = xparent->right;
+				}
+				w->red = xparent->red;
+				xparent->red = 0;
+				if (w->right) {
+					w->right->red = 0;
+				}
+				simos_rb_rotate_left(tree, xparent);
+				x = tree->root;
+			}
+		} else {
+			w = xparent->left;
+			if (w->red) {
+				w->red = 0;
+				xparent->red = 1;
+				simos_rb_rotate_right(tree, xparent);
+				w = xparent->left;
+			}
+			if ((w->left == NULL || ! w->left->red)
+					&& (w->right == NULL || ! w->right->red)) {
+				w->red = 1;
+				x = xparent;
+				xparent = x->parent;
+			} else {
+				if (w->left == NULL || ! w->left->red) {
+					w->right->red = 0;
+					w->red = 1;
+					simos_rb_rotate_left(tree, w);
+					w = xparent->left;
+				}
+				w->red = xparent->red;
+				xparent->red = 0;
+				if (w->left) {
+					w->left->red = 0;
+				}
+				simos_rb_rotate_right(tree, xparent);
+				x = tree->root;
+			}
+		}
+	}
+	if (x) {
+		x->red = 0;
+	}
+}
+
+/**
+ * Node with the smallest key, NULL if empty. O(1), it is cached.
+ */
+simos_rb_node_t *simos_rb_first(simos_rb_tree_t *tree)
+{
+	return tree->first;
+}
+
+/**
+ * Node with the largest key, NULL if empty.
+ */
+simos_rb_node_t *simos_rb_last(simos_rb_tree_t *tree)
+{
+	simos_rb_node_t *n = tree->root;
+
+	while (n && n->right) {
+		n = n->right;
+	}
+
+	return n;
+}
+
+/**
+ * Node following `node' in key order, NULL if none.
+ */
+simos_rb_node_t *simos_rb_next(simos_rb_node_t *node)
+{
+	simos_rb_node_t *parent;
+
+	if (node->right) {
+		node = node->right;
+		while (node->left) {
+			node = node->left;
+		}
+		return node;
+	}
+
+	while ((parent = node->parent) && node == parent->right) {
+		node = parent;
+	}
+
+	return parent;
+}
+
+/**
+ * Node preceding `node' in key order, NULL if none.
+ */
+simos_rb_node_t *simos_rb_prev(simos_rb_node_t *node)
+{
+	simos_rb_node_t *parent;
+
+	if (node->left) {
+		node = node->left;
+		while (node->right) {
+			node = node->right;
+		}
+		return node;
+	}
+
+	while ((parent = node->parent) && node == parent->left) {
+		node = parent;
+	}
+
+	return parent;
+}
+
+/**
+ * First node whose key is not less than `key', NULL if none. O(log n).
+ */
+simos_rb_node_t *simos_rb_lower_bound(simos_rb_tree_t *tree, size_t key)
+{
+	simos_rb_node_t *n = tree->root, *found = NULL;
+
+	while (n) {
+		if (n->key >= key) {
+			found = n;
+			n = n->left;
+		} else {
+			n = n->right;
+		}
+	}
+
+	return found;
+}
@@ -25,6 +25,8 @@
 #include <time.h>
 #include "simos.h"
 
+/** Process holding the CPU, used to tell a context switch. */
+static simos_process_t *simos_current = NULL;
 
 /** Create a new ready process list. */
 simos_scheduler_t *simos_scheduler_new()
@@ -85,15 +87,196 @@ simos_process_t *simos_process_list_get(simos_list_t *proclist, int pid)
 simos_scheduler_conf_t *create_scheduler_conf()
 {
 	simos_scheduler_conf_t *c = malloc(sizeof(simos_scheduler_conf_t));
+	int i;
 
 	c->sort_sjf = 0;
 	c->sort_srtf = 0;
 	c->priority = 0;
 	c->auto_quantum = 0;
+	c->switch_cost = 0;
+	c->warmth_penalty = 0;
+	c->warmth_halflife = 1;
+	c->affinity = 0;
+
+	c->mlfq_levels = 8;
+	for (i = 0; i < SIMOS_MLFQ_MAX; i++) {
+		c->mlfq_quantum[i] = 10 << (i < 8 ? i : 8);
+	}
+	c->mlfq_boost = 5000;
+
+	c->cfs_latency = 200;
+	c->cfs_granularity = 20;
+
+	c->share_quantum = 10;
+
+	c->rt_horizon = 10000;
+	c->aging_interval = 100;
+
+	c->predict_alpha = 50;
+	c->quantum_percentile = 80;
+	c->quantum_max = 20;
+	for (i = 0; i < SIMOS_BURST_HIST; i++) {
+		c->burst_hist[i] = 0;
+	}
+	c->bursts = 0;
+	c->tick = NULL;
+	c->tick_arg = NULL;
+	c->io = NULL;
+	c->groups = NULL;
+	c->timers = NULL;
 
 	return c;
 }
 
+/**
+ * Give the CPU to `p'. Switching from another process costs switch_cost
+ * plus the part of warmth_penalty the process lost while away.
+ */
+static void simos_dispatch(simos_scheduler_conf_t *conf, simos_process_t *p,
+		size_t *simostime)
+{
+	size_t cost, halves;
+	int same = simos_current && simos_current->leader == p->leader;
+
+	if (p == simos_current) {
+		return;
+	}
+	simos_current = p;
+
+	/* a thread of the same process finds its address space warm */
+	cost = conf->switch_cost;
+	if (conf->warmth_penalty && ! same) {
+		halves = (*simostime - p->last_run) / conf->warmth_halflife;
+		if (p->running_time == 0 || halves >= 8 * sizeof(size_t)) {
+			cost += conf->warmth_penalty; // never ran or long gone
+		} else {
+			cost += conf->warmth_penalty
+				- (conf->warmth_penalty >> halves);
+		}
+	}
+
+	(*simostime) += cost;
+	p->switches++;
+	p->switch_time += cost;
+}
+
+/** `p' leaves the CPU. */
+static void simos_preempt(simos_process_t *p, size_t *simostime)
+{
+	p->last_run = *simostime;
+}
+
+/**
+ * Affinity: among `n' and the next conf->affinity processes, bring the one
+ * which left the CPU most recently (the warmest) to `n'.
+ */
+static void simos_affinity(simos_scheduler_conf_t *conf, simos_list_node_t *n)
+{
+	simos_list_node_t *m, *warmest = n;
+	simos_process_t *p;
+	void *data;
+	int i;
+
+	for (m = n->next, i = 0; m && i < conf->affinity; m = m->next, i++) {
+		p = simos_node_to_process(m);
+		if (p->running_time
+				&& p->last_run > simos_node_to_process(warmest)->last_run) {
+			warmest = m;
+		}
+	}
+
+	if (warmest != n) {
+		data = n->data;
+		n->data = warmest->data;
+		warmest->data = data;
+	}
+}
+
+/** Tell the scheduler `p' ran a CPU burst of `burst' units of time. */
+void simos_scheduler_burst(simos_scheduler_conf_t *conf, simos_process_t *p,
+		size_t burst)
+{
+	int i, b = 0;
+
+	simos_process_burst(p, burst, conf->predict_alpha);
+
+	while (b < SIMOS_BURST_HIST - 1 && (burst >> (b + 1))) {
+		b++;
+	}
+	conf->burst_hist[b]++;
+
+	// forget old bursts little by little
+	if (++conf->bursts >= SIMOS_BURST_WINDOW) {
+		conf->bursts = 0;
+		for (i = 0; i < SIMOS_BURST_HIST; i++) {
+			conf->burst_hist[i] >>= 1;
+			conf->bursts += conf->burst_hist[i];
+		}
+	}
+}
+
+/**
+ * Quantum for the bursts seen so far. A quantum lasts 50 units of time
+ * (see funcr), bursts are known up to a power of two.
+ */
+size_t simos_adaptive_quantum(simos_scheduler_conf_t *conf)
+{
+	size_t seen = 0, longest = 0, q;
+	int b;
+
+	for (b = 0; b < SIMOS_BURST_HIST && conf->bursts; b++) {
+		seen += conf->burst_hist[b];
+		if (seen * 100 >= conf->bursts * conf->quantum_percentile) {
+			longest = ((size_t) 2 << b) - 1;
+			break;
+		}
+	}
+
+	q = (longest + 49) / 50;
+	if (q < (conf->switch_cost * 10 + 49) / 50) {
+		q = (conf->switch_cost * 10 + 49) / 50;
+	}
+
+	if (q > conf->quantum_max) {
+		q = conf->quantum_max;
+	}
+	return q ? q : 1;
+}
+
+/** Sort key of SJF and SRTF, the real burst or the predicted one. */
+static int (* simos_sjf_key(int sort))(simos_list_node_t *node)
+{
+	return (sort == SIMOS_SORT_PREDICT) ? &get_burst_estimate
+		: &get_required_execution_time;
+}
+
+/** Let the rest of the system work while `p' holds the CPU for a tick. */
+static void simos_scheduler_tick(simos_scheduler_conf_t *conf,
+		simos_process_t *p, size_t *simostime)
+{
+	if (conf->tick) {
+		conf->tick(conf->tick_arg, p, simostime);
+	}
+}
+
+/** The CPU idles until `until', the timers due meanwhile fire on time. */
+static void simos_idle(simos_scheduler_conf_t *conf, size_t *simostime,
+		size_t until)
+{
+	size_t when;
+
+	while (conf->timers && (when = simos_wheel_next(conf->timers)) < until) {
+		if (when > *simostime) {
+			*simostime = when;
+		}
+		simos_wheel_advance(conf->timers, *simostime);
+	}
+
+	if (until > *simostime) {
+		*simostime = until;
+	}
+}
+
 /*****************************************************************
  * First-Come, First-Served (FCFS)
  * Shortest-Job-First (SJF)
@@ -104,6 +287,7 @@ void simos_run(simos_list_t *ready, simos_list_t *finished,
 {
 	simos_list_node_t *n;
 	simos_process_t *p;
+	size_t t;
 
 	// set entry time and running time
 	SIMOS_LIST_FOREACH(n, ready) {
@@ -116,11 +300,16 @@ void simos_run(simos_list_t *ready, simos_list_t *finished,
 
 	// FCFS else SJF else SRTF
 	if(conf->sort_sjf) {
-		simos_list_sort(ready, &get_required_execution_time);
+		simos_list_sort(ready, simos_sjf_key(conf->sort_sjf));
+	} else if(conf->sort_srtf == SIMOS_SORT_PREDICT) {
+		// nothing ran yet, what remains is the whole burst
+		simos_list_sort(ready, &get_burst_estimate);
 	} else if(conf->sort_srtf) {
 		simos_list_sort(ready, &get_remaining_time);
 	}
 
+	simos_current = NULL;
+
 	// for each node in scheduler's ready list do:
 	SIMOS_LIST_FOREACH(n, ready) {
 		printf("Current time is: %6ld - ", *simostime);
@@ -130,7 +319,12 @@ void simos_run(simos_list_t *ready, simos_list_t *finished,
 		p = simos_node_to_process(n);
 		printf("Process need %4d time. ",
 				(int) p->required_execution_time);
-		(*simostime) += p->required_execution_time;
+		simos_dispatch(conf, p, simostime);
+		for (t = 0; t < p->required_execution_time; t++) {
+			(*simostime)++;
+			simos_scheduler_tick(conf, p, simostime);
+		}
+		simos_preempt(p, simostime);
 		p->out_time = *simostime;
 		p->running_time = *simostime;
 		printf("Process %2d leaving at %ld.\n", p->pid, *simostime);
@@ -155,11 +349,16 @@ void funcr(simos_list_t *ready, simos_list_t *finished,
 	
 	// for each node in scheduler's ready list do:
 	SIMOS_LIST_FOREACH(n, ready) {
+		if (conf->affinity) {
+			simos_affinity(conf, n);
+		}
+
 		printf("Current time is: %6ld - ", *simostime);
 
 
 		/* time accounting */
 		p = simos_node_to_process(n);
+		simos_dispatch(conf, p, simostime);
 		printf("Process %2d. Quantum %1d. Priority %1d. ",
 			p->pid,
 			(int) p->quantum,
@@ -171,6 +370,7 @@ void funcr(simos_list_t *ready, simos_list_t *finished,
 			timeint++; //cpu time int
 
 			p->running_time++;
+			simos_scheduler_tick(conf, p, simostime);
 			node_finished = p->required_execution_time <= p->running_time;
 			if(conf->priority) {
 				cpuint = !(timeint%(20*(6-p->priority)));
@@ -179,6 +379,7 @@ void funcr(simos_list_t *ready, simos_list_t *finished,
 			}
 		}
 
+		simos_preempt(p, simostime);
 		printf("Need %4d time. Running at %4d. ",
 				(int) p->required_execution_time,
 				(int) p->running_time);
@@ -213,14 +414,23 @@ void simos_run_rr(simos_list_t *ready, simos_list_t *finished,
 	simos_process_t *p;
 	
 	int has_node = 1;
+	size_t quantum = 1;
 
+	simos_current = NULL;
 	srand(time(NULL));
+	if (conf->auto_quantum == SIMOS_QUANTUM_ADAPTIVE) {
+		quantum = simos_adaptive_quantum(conf);
+		printf("Adaptive quantum %d.\n", (int) quantum);
+	}
+
 	SIMOS_LIST_FOREACH(n, ready) {
 		p = simos_node_to_process(n);
 		p->entry_time = *simostime;
 		(*simostime)++;
 
-		if(conf->auto_quantum){
+		if (conf->auto_quantum == SIMOS_QUANTUM_ADAPTIVE) {
+			p->quantum = quantum;
+		} else if(conf->auto_quantum){
 			if (! (p->required_execution_time%2)) {
 				p->quantum = 2;
 			}
@@ -235,7 +445,7 @@ void simos_run_rr(simos_list_t *ready, simos_list_t *finished,
 		simos_list_sort(ready, &get_priority);
 	} else {
 		if (conf->sort_sjf) {
-			simos_list_sort(ready, &get_required_execution_time);
+			simos_list_sort(ready, simos_sjf_key(conf->sort_sjf));
 		}
 	}
 
@@ -260,6 +470,7 @@ void simos_run_queue(simos_list_t *ready, simos_list_t *finished,
 
 	q0 = simos_list_new();
 	q1 = simos_list_new();
+	simos_current = NULL;
 
 	//select queue by 1 or 2
 	n = ready->head;
@@ -287,8 +498,8 @@ void simos_run_queue(simos_list_t *ready, simos_list_t *finished,
 	}
 
 	if(conf->sort_sjf) {
-		simos_list_sort(q0, &get_required_execution_time);
-		simos_list_sort(q1, &get_required_execution_time);
+		simos_list_sort(q0, simos_sjf_key(conf->sort_sjf));
+		simos_list_sort(q1, simos_sjf_key(conf->sort_sjf));
 	}
 
 	while (has_node) {
@@ -308,3 +519,1704 @@ void simos_run_queue(simos_list_t *ready, simos_list_t *finished,
 					|| (! simos_list_empty(q1));
 	}
 }
+
+/*****************************************************************
+ * Multilevel feedback queue (MLFQ)
+ *
+ * One list for each level and a bit map of the non-empty levels, so the
+ * next process is found with a single count-trailing-zeros whatever the
+ * number of ready processes.
+ ****************************************************************/
+void simos_run_mlfq(simos_list_t *ready, simos_list_t *finished,
+		simos_scheduler_conf_t *conf, size_t *simostime)
+{
+	simos_list_node_t *n;
+	simos_process_t *p;
+
+	simos_list_t *q[SIMOS_MLFQ_MAX];
+	unsigned long nonempty = 0;
+	size_t next_boost, quantum;
+	int levels = conf->mlfq_levels;
+	int i, level;
+
+	if (levels < 1) {
+		levels = 1;
+	} else if (levels > SIMOS_MLFQ_MAX) {
+		levels = SIMOS_MLFQ_MAX;
+	}
+
+	for (i = 0; i < levels; i++) {
+		q[i] = simos_list_new();
+	}
+	simos_current = NULL;
+
+	SIMOS_LIST_FOREACH(n, ready) {
+		p = simos_node_to_process(n);
+		p->entry_time = *simostime;
+		(*simostime)++;
+	}
+	next_boost = *simostime + conf->mlfq_boost;
+
+	while (1) {
+		/* new processes come at the top level */
+		if (! simos_list_empty(ready)) {
+			simos_list_append(q[0], ready);
+			nonempty |= 1UL;
+		}
+
+		if (! nonempty) {
+			break;
+		}
+
+		level = __builtin_ctzl(nonempty);
+		n = simos_list_del_head(q[level]);
+		n->next = n->prev = NULL;
+		if (simos_list_empty(q[level])) {
+			nonempty &= ~(1UL << level);
+		}
+
+		p = simos_node_to_process(n);
+		printf("Current time is: %6ld - ", *simostime);
+		simos_dispatch(conf, p, simostime);
+		printf("Process %2d. Level %2d. ", p->pid, level);
+
+		quantum = conf->mlfq_quantum[level];
+		while (quantum && p->running_time < p->required_execution_time) {
+			(*simostime)++;
+			p->running_time++;
+			quantum--;
+			simos_scheduler_tick(conf, p, simostime);
+		}
+		simos_preempt(p, simostime);
+
+		printf("Need %4d time. Running at %4d. ",
+				(int) p->required_execution_time,
+				(int) p->running_time);
+
+		if (p->running_time >= p->required_execution_time) {
+			printf("[ Finished at %4d ]", (int) p->running_time);
+			p->out_time = *simostime;
+			p->turnaround_time = p->out_time - p->entry_time;
+			simos_list_add(finished, n);
+		} else {
+			/* the whole quantum was used: demote */
+			if (quantum == 0 && level < levels - 1) {
+				level++;
+			}
+			simos_list_add(q[level], n);
+			nonempty |= 1UL << level;
+		}
+		printf("\n");
+
+		/* priority boost: splice every level into the top one */
+		if (conf->mlfq_boost && *simostime >= next_boost) {
+			for (i = 1; i < levels; i++) {
+				simos_list_append(q[0], q[i]);
+			}
+			nonempty = simos_list_empty(q[0]) ? 0 : 1UL;
+			next_boost = *simostime + conf->mlfq_boost;
+			printf("[ Boost at %ld ]\n", *simostime);
+		}
+	}
+
+	for (i = 0; i < levels; i++) {
+		free(q[i]);
+	}
+}
+
+/*****************************************************************
+ * Completely Fair Scheduler (CFS)
+ *
+ * Ready processes are kept in a red-black tree ordered by vruntime, the
+ * time they ran weighted by their priority. The leftmost one, which had
+ * the least of its fair share, runs next.
+ ****************************************************************/
+
+/** vruntime of one unit of time of a process with weight 1024. */
+#define SIMOS_CFS_NICE_0 1024
+
+/** Weight of priorities 0 (highest) to 5, each ~1.25x the next one. */
+static const size_t simos_cfs_weight[6] = {1024, 820, 655, 526, 423, 335};
+
+static size_t simos_cfs_weight_of(simos_process_t *p)
+{
+	return simos_cfs_weight[p->priority < 6 ? p->priority : 5];
+}
+
+/**
+ * A process joins the tree. It must not be owed the time it was not
+ * there, so it starts no lower than the smallest vruntime around.
+ */
+static void simos_cfs_enqueue(simos_rb_tree_t *tree, simos_rb_node_t *rb,
+		size_t min_vruntime, size_t *load)
+{
+	simos_process_t *p = simos_node_to_process(rb->data);
+
+	if (p->vruntime < min_vruntime) {
+		p->vruntime = min_vruntime;
+	}
+	rb->key = p->vruntime;
+	simos_rb_insert(tree, rb);
+	*load += simos_cfs_weight_of(p);
+}
+
+/*****************************************************************
+ * CFS over a tree of groups
+ *
+ * Each group keeps its ready processes and its child groups with ready
+ * processes in two trees by vruntime. From the root down, the leftmost
+ * entity runs next: if a group, its own leftmost, and so on. A group's
+ * vruntime advances by its weight as its processes run, so siblings share
+ * the CPU of their parent whatever the number of processes below them.
+ * A group out of its quota leaves its parent until the next period.
+ ****************************************************************/
+
+/** The group has something ready: queue it in its parent, and up. */
+static void simos_cfs_group_enqueue(simos_group_t *g)
+{
+	simos_group_t *parent;
+
+	for (; g->parent && ! g->queued && ! g->throttled; g = parent) {
+		parent = g->parent;
+		if (g->vruntime < parent->min_vruntime) {
+			g->vruntime = parent->min_vruntime;
+		}
+		g->rb.key = g->vruntime;
+		simos_rb_insert(parent->kids, &g->rb);
+		g->queued = 1;
+		parent->load += g->weight;
+	}
+}
+
+/** The group has nothing ready: take it from its parent, and up. */
+static void simos_cfs_group_dequeue(simos_group_t *g)
+{
+	simos_group_t *parent;
+
+	for (; g->parent && g->queued && g->load == 0; g = parent) {
+		parent = g->parent;
+		simos_rb_del(parent->kids, &g->rb);
+		g->queued = 0;
+		parent->load -= g->weight;
+	}
+}
+
+/** A process arrives at its group. */
+static void simos_cfs_group_add(simos_group_t *g, simos_rb_node_t *rb)
+{
+	simos_process_t *p = simos_node_to_process(rb->data);
+
+	if (p->vruntime < g->min_vruntime) {
+		p->vruntime = g->min_vruntime;
+	}
+	rb->key = p->vruntime;
+	simos_rb_insert(g->procs, rb);
+	g->load += simos_cfs_weight_of(p);
+	simos_cfs_group_enqueue(g);
+}
+
+/**
+ * Leftmost process from the group down, its slice is the period split by
+ * the weights on the way. NULL if nothing is ready.
+ */
+static simos_rb_node_t *simos_cfs_group_pick(simos_group_t *g,
+		size_t period, size_t *slice)
+{
+	simos_rb_node_t *a, *b;
+
+	*slice = period;
+	for (;;) {
+		a = simos_rb_first(g->procs);
+		b = simos_rb_first(g->kids);
+		if (b && (a == NULL || b->key < a->key)) {
+			*slice = *slice * ((simos_group_t *) b->data)->weight / g->load;
+			g = b->data;
+			continue;
+		}
+		if (a) {
+			*slice = *slice * simos_cfs_weight_of(
+					simos_node_to_process(a->data)) / g->load;
+		}
+		return a;
+	}
+}
+
+/** min_vruntime of the group only moves forward. */
+static void simos_cfs_group_min(simos_group_t *g)
+{
+	simos_rb_node_t *a = simos_rb_first(g->procs);
+	simos_rb_node_t *b = simos_rb_first(g->kids);
+	size_t m;
+
+	if (a == NULL && b == NULL) {
+		return;
+	}
+	m = (a && (b == NULL || a->key < b->key)) ? a->key : b->key;
+	if (m > g->min_vruntime) {
+		g->min_vruntime = m;
+	}
+}
+
+/** Out of its quota: the group waits for its next period. */
+static void simos_cfs_group_throttle(simos_group_t *g, simos_list_t *throttled)
+{
+	if (g->queued) {
+		simos_rb_del(g->parent->kids, &g->rb);
+		g->queued = 0;
+		g->parent->load -= g->weight;
+		simos_cfs_group_dequeue(g->parent);
+	}
+	g->throttled = 1;
+	g->throttles++;
+	simos_list_add(throttled, simos_list_new_node(g));
+}
+
+/**
+ * Give back their CPU to the groups whose period is over. Return the time
+ * the next one is, -1 if none is throttled.
+ */
+static size_t simos_cfs_group_unthrottle(simos_list_t *throttled, size_t now)
+{
+	simos_list_node_t *n, *next;
+	simos_group_t *g;
+	size_t next_at = -1;
+
+	for (n = throttled->head; n; n = next) {
+		next = n->next;
+		g = n->data;
+		if (now < g->period_start + g->period) {
+			if (g->period_start + g->period < next_at) {
+				next_at = g->period_start + g->period;
+			}
+			continue;
+		}
+		g->period_start = now - (now - g->period_start) % g->period;
+		g->used = 0;
+		g->throttled = 0;
+		if (g->load) {
+			simos_cfs_group_enqueue(g);
+		}
+		simos_list_unlink(throttled, n);
+		free(n);
+	}
+	return next_at;
+}
+
+static void simos_run_cfs_groups(simos_list_t *ready, simos_list_t *finished,
+		simos_scheduler_conf_t *conf, size_t *simostime)
+{
+	simos_group_t *root = conf->groups, *g, *out;
+	simos_list_t *throttled = simos_list_new();
+	simos_rb_tree_t *arrivals = simos_rb_new();
+	simos_list_node_t *n;
+	simos_rb_node_t *rb, *first;
+	simos_process_t *p;
+	size_t nr = 0, nr_latency, period, slice, ran, weight, next_at;
+
+	simos_current = NULL;
+	srand(time(NULL));
+
+	nr_latency = conf->cfs_latency / (conf->cfs_granularity
+			? conf->cfs_granularity : 1);
+
+	while (1) {
+		/* processes admitted to the system wait for their arrival */
+		while ((n = simos_list_del_head(ready)) != NULL) {
+			n->next = n->prev = NULL;
+			p = simos_node_to_process(n);
+			if (conf->priority) {
+				p->priority = rand() % 6; //6 Priority: 0-5
+			}
+			simos_rb_insert(arrivals, simos_rb_new_node(n,
+					p->arrival_time));
+		}
+
+		while ((rb = simos_rb_first(arrivals))
+				&& rb->key <= *simostime) {
+			simos_rb_del(arrivals, rb);
+			p = simos_node_to_process(rb->data);
+			p->entry_time = *simostime;
+			simos_cfs_group_add(p->group ? p->group : root, rb);
+			nr++;
+		}
+		next_at = simos_cfs_group_unthrottle(throttled, *simostime);
+
+		/* the period stretches when too many processes are ready */
+		period = conf->cfs_latency;
+		if (nr > nr_latency) {
+			period = nr * conf->cfs_granularity;
+		}
+
+		rb = simos_cfs_group_pick(root, period, &slice);
+		if (rb == NULL) {
+			first = simos_rb_first(arrivals);
+			if (first && first->key < next_at) {
+				next_at = first->key;
+			}
+			if (next_at == (size_t) -1) {
+				break;
+			}
+			/* idle until an arrival or a group's next period */
+			simos_idle(conf, simostime, next_at);
+			continue;
+		}
+
+		n = rb->data;
+		p = simos_node_to_process(n);
+		g = p->group ? p->group : root;
+		weight = simos_cfs_weight_of(p);
+		simos_rb_del(g->procs, rb);
+		if (slice < conf->cfs_granularity) {
+			slice = conf->cfs_granularity;
+		}
+		if (slice == 0) {
+			slice = 1;
+		}
+
+		printf("Current time is: %6ld - ", *simostime);
+		simos_dispatch(conf, p, simostime);
+		printf("Process %2d. Group %s. Slice %4d. ", p->pid, g->name,
+				(int) slice);
+
+		out = NULL;
+		for (ran = 0; ran < slice && out == NULL
+				&& p->running_time < p->required_execution_time; ran++) {
+			(*simostime)++;
+			p->running_time++;
+			p->vruntime += SIMOS_CFS_NICE_0 * SIMOS_CFS_NICE_0 / weight;
+			simos_scheduler_tick(conf, p, simostime);
+			out = simos_group_run(g, 1, *simostime);
+		}
+		simos_preempt(p, simostime);
+
+		/* the groups above ran as well, as much as their weight says */
+		for (; g->parent; g = g->parent) {
+			g->vruntime += ran * SIMOS_CFS_NICE_0 * SIMOS_CFS_NICE_0
+				/ g->weight;
+			if (g->queued) {
+				simos_rb_del(g->parent->kids, &g->rb);
+				g->rb.key = g->vruntime;
+				simos_rb_insert(g->parent->kids, &g->rb);
+			}
+		}
+		g = p->group ? p->group : root;
+
+		printf("Need %4d time. Running at %4d. ",
+				(int) p->required_execution_time,
+				(int) p->running_time);
+
+		if (p->running_time >= p->required_execution_time) {
+			printf("[ Finished at %4d ]", (int) p->running_time);
+			p->out_time = *simostime;
+			p->turnaround_time = p->out_time - p->entry_time;
+			simos_list_add(finished, n);
+			free(rb);
+			g->load -= weight;
+			simos_cfs_group_dequeue(g);
+			nr--;
+		} else {
+			rb->key = p->vruntime;
+			simos_rb_insert(g->procs, rb);
+		}
+
+		for (; g; g = g->parent) {
+			simos_cfs_group_min(g);
+		}
+		if (out) {
+			printf("[ Group %s throttled ]", out->name);
+			simos_cfs_group_throttle(out, throttled);
+		}
+		printf("\n");
+	}
+
+	free(throttled);
+	free(arrivals);
+}
+
+void simos_run_cfs(simos_list_t *ready, simos_list_t *finished,
+		simos_scheduler_conf_t *conf, size_t *simostime)
+{
+	simos_list_node_t *n;
+	simos_rb_node_t *rb, *first;
+	simos_process_t *p;
+
+	simos_rb_tree_t *tree;
+	/* processes yet to arrive, ordered by arrival time */
+	simos_rb_tree_t *arrivals;
+	size_t min_vruntime = 0;
+	size_t load = 0;
+	size_t nr_latency, period, slice, ran, weight, vgran;
+
+	if (conf->groups) {
+		simos_run_cfs_groups(ready, finished, conf, simostime);
+		return;
+	}
+
+	tree = simos_rb_new();
+	arrivals = simos_rb_new();
+	simos_current = NULL;
+	srand(time(NULL));
+
+	nr_latency = conf->cfs_latency / (conf->cfs_granularity
+			? conf->cfs_granularity : 1);
+
+	while (1) {
+		/* processes admitted to the system wait for their arrival */
+		while ((n = simos_list_del_head(ready)) != NULL) {
+			n->next = n->prev = NULL;
+			p = simos_node_to_process(n);
+			if (conf->priority) {
+				p->priority = rand() % 6; //6 Priority: 0-5
+			}
+			simos_rb_insert(arrivals, simos_rb_new_node(n,
+					p->arrival_time));
+		}
+
+		while ((rb = simos_rb_first(arrivals))
+				&& rb->key <= *simostime) {
+			simos_rb_del(arrivals, rb);
+			p = simos_node_to_process(rb->data);
+			p->entry_time = *simostime;
+			simos_cfs_enqueue(tree, rb, min_vruntime, &load);
+		}
+
+		if (simos_rb_empty(tree)) {
+			if (simos_rb_empty(arrivals)) {
+				break;
+			}
+			/* idle until the next arrival */
+			simos_idle(conf, simostime, simos_rb_first(arrivals)->key);
+			continue;
+		}
+
+		rb = simos_rb_first(tree);
+		simos_rb_del(tree, rb);
+		n = rb->data;
+		p = simos_node_to_process(n);
+		weight = simos_cfs_weight_of(p);
+
+		/* the period stretches when too many processes are ready */
+		period = conf->cfs_latency;
+		if (tree->len + 1 > nr_latency) {
+			period = (tree->len + 1) * conf->cfs_granularity;
+		}
+		slice = period * weight / load;
+		if (slice < conf->cfs_granularity) {
+			slice = conf->cfs_granularity;
+		}
+		if (slice == 0) {
+			slice = 1;
+		}
+		vgran = conf->cfs_granularity * SIMOS_CFS_NICE_0;
+
+		printf("Current time is: %6ld - ", *simostime);
+		simos_dispatch(conf, p, simostime);
+		printf("Process %2d. Priority %1d. Slice %4d. ", p->pid,
+				(int) p->priority, (int) slice);
+
+		for (ran = 0; ran < slice
+				&& p->running_time < p->required_execution_time; ran++) {
+			(*simostime)++;
+			p->running_time++;
+			p->vruntime += SIMOS_CFS_NICE_0 * SIMOS_CFS_NICE_0 / weight;
+			simos_scheduler_tick(conf, p, simostime);
+
+			/* wakeup preemption by a late arrival far behind */
+			first = simos_rb_first(arrivals);
+			if (first && first->key <= *simostime) {
+				while ((first = simos_rb_first(arrivals))
+						&& first->key <= *simostime) {
+					simos_rb_del(arrivals, first);
+					simos_node_to_process(first->data)->entry_time
+						= *simostime;
+					simos_cfs_enqueue(tree, first, min_vruntime, &load);
+				}
+				first = simos_rb_first(tree);
+				if (ran + 1 >= conf->cfs_granularity
+						&& first->key + vgran < p->vruntime) {
+					ran++;
+					break;
+				}
+			}
+		}
+		simos_preempt(p, simostime);
+		load -= weight;
+
+		/* min_vruntime only moves forward */
+		first = simos_rb_first(tree);
+		if (first && first->key < p->vruntime) {
+			if (first->key > min_vruntime) {
+				min_vruntime = first->key;
+			}
+		} else if (p->vruntime > min_vruntime) {
+			min_vruntime = p->vruntime;
+		}
+
+		printf("Need %4d time. Running at %4d. ",
+				(int) p->required_execution_time,
+				(int) p->running_time);
+
+		if (p->running_time >= p->required_execution_time) {
+			printf("[ Finished at %4d ]", (int) p->running_time);
+			p->out_time = *simostime;
+			p->turnaround_time = p->out_time - p->entry_time;
+			simos_list_add(finished, n);
+			free(rb);
+		} else {
+			rb->key = p->vruntime;
+			simos_rb_insert(tree, rb);
+			load += weight;
+		}
+		printf("\n");
+	}
+
+	free(tree);
+	free(arrivals);
+}
+
+/**
+ * Run `p' for at most `slice' units of time. Return the time it ran.
+ */
+static size_t simos_run_slice(simos_scheduler_conf_t *conf,
+		simos_process_t *p, size_t slice, size_t *simostime)
+{
+	size_t ran;
+
+	simos_dispatch(conf, p, simostime);
+	for (ran = 0; ran < slice
+			&& p->running_time < p->required_execution_time; ran++) {
+		(*simostime)++;
+		p->running_time++;
+		simos_scheduler_tick(conf, p, simostime);
+	}
+	simos_preempt(p, simostime);
+
+	printf("Need %4d time. Running at %4d. ",
+			(int) p->required_execution_time,
+			(int) p->running_time);
+
+	return ran;
+}
+
+/**
+ * Move the node to finished whether its process is done. Return true or
+ * false.
+ */
+static int simos_finish(simos_list_t *finished, simos_list_node_t *n,
+		size_t *simostime)
+{
+	simos_process_t *p = simos_node_to_process(n);
+
+	if (p->running_time < p->required_execution_time) {
+		return 0;
+	}
+
+	printf("[ Finished at %4d ]", (int) p->running_time);
+	p->out_time = *simostime;
+	p->turnaround_time = p->out_time - p->entry_time;
+	n->next = n->prev = NULL;
+	simos_list_add(finished, n);
+
+	return 1;
+}
+
+/*****************************************************************
+ * Lottery scheduling
+ *
+ * Each process holds tickets in a slot of a Fenwick tree, a random
+ * ticket is drawn and its holder found in O(log n).
+ ****************************************************************/
+
+/** Tickets of a process, no process is left without a chance. */
+static size_t simos_tickets(simos_process_t *p)
+{
+	return p->tickets ? p->tickets : 1;
+}
+
+void simos_run_lottery(simos_list_t *ready, simos_list_t *finished,
+		simos_scheduler_conf_t *conf, size_t *simostime)
+{
+	simos_list_node_t *n;
+	simos_process_t *p;
+
+	simos_list_node_t **slots = NULL;
+	size_t *held = NULL;
+	simos_fenwick_t *tickets = simos_fenwick_new(0);
+	size_t len = 0, size = 0;
+	size_t i, slot, ticket;
+
+	simos_current = NULL;
+	srand(time(NULL));
+
+	while (1) {
+		/* new processes get the next slots */
+		while ((n = simos_list_del_head(ready)) != NULL) {
+			p = simos_node_to_process(n);
+			p->entry_time = *simostime;
+			(*simostime)++;
+
+			if (len == size) {
+				/* grow and rebuild the tree, amortized O(1) */
+				size = size ? 2 * size : 64;
+				slots = realloc(slots, size * sizeof(simos_list_node_t *));
+				held = realloc(held, size * sizeof(size_t));
+				simos_fenwick_free(tickets);
+				tickets = simos_fenwick_new(size);
+				for (i = 0; i < len; i++) {
+					simos_fenwick_add(tickets, i, held[i]);
+				}
+			}
+			slots[len] = n;
+			held[len] = simos_tickets(p);
+			simos_fenwick_add(tickets, len, held[len]);
+			len++;
+		}
+
+		if (tickets->total == 0) {
+			break;
+		}
+
+		ticket = (((size_t) rand() << 31) | rand()) % tickets->total;
+		slot = simos_fenwick_find(tickets, ticket);
+		n = slots[slot];
+		p = simos_node_to_process(n);
+
+		printf("Current time is: %6ld - ", *simostime);
+		printf("Process %2d. Tickets %4d. ", p->pid, (int) held[slot]);
+		simos_run_slice(conf, p, conf->share_quantum, simostime);
+
+		if (simos_finish(finished, n, simostime)) {
+			simos_fenwick_add(tickets, slot, -(long) held[slot]);
+			held[slot] = 0;
+		} else if (simos_tickets(p) != held[slot]) {
+			/* tickets changed while running */
+			simos_fenwick_add(tickets, slot,
+					(long) simos_tickets(p) - (long) held[slot]);
+			held[slot] = simos_tickets(p);
+		}
+		printf("\n");
+	}
+
+	free(slots);
+	free(held);
+	simos_fenwick_free(tickets);
+}
+
+/*****************************************************************
+ * Stride scheduling
+ *
+ * Each process advances its pass by a stride inversely proportional to
+ * its tickets; the smallest pass runs next, taken from a heap.
+ ****************************************************************/
+#define SIMOS_STRIDE1 (1 << 20)
+
+void simos_run_stride(simos_list_t *ready, simos_list_t *finished,
+		simos_scheduler_conf_t *conf, size_t *simostime)
+{
+	simos_list_node_t *n;
+	simos_process_t *p;
+
+	simos_heap_t *heap = simos_heap_new();
+	size_t global_pass = 0;
+
+	simos_current = NULL;
+
+	while (1) {
+		/* new processes start a stride after the current pass */
+		while ((n = simos_list_del_head(ready)) != NULL) {
+			p = simos_node_to_process(n);
+			p->entry_time = *simostime;
+			(*simostime)++;
+			p->pass = global_pass + SIMOS_STRIDE1 / simos_tickets(p);
+			simos_heap_push(heap, p->pass, n);
+		}
+
+		if (simos_heap_empty(heap)) {
+			break;
+		}
+
+		global_pass = simos_heap_top(heap)->key;
+		n = simos_heap_pop(heap);
+		p = simos_node_to_process(n);
+
+		printf("Current time is: %6ld - ", *simostime);
+		printf("Process %2d. Tickets %4d. ", p->pid, (int) simos_tickets(p));
+		simos_run_slice(conf, p, conf->share_quantum, simostime);
+
+		if (! simos_finish(finished, n, simostime)) {
+			p->pass += SIMOS_STRIDE1 / simos_tickets(p);
+			simos_heap_push(heap, p->pass, n);
+		}
+		printf("\n");
+	}
+
+	simos_heap_free(heap);
+}
+
+/*****************************************************************
+ * Earliest Deadline First (EDF)
+ * Rate Monotonic (RM)
+ *
+ * Ready jobs wait in a heap ordered by absolute deadline (EDF) or by
+ * period (RM), future releases in a heap ordered by release time.
+ ****************************************************************/
+
+/** Work of a job of the task. */
+static size_t simos_rt_wcet(simos_process_t *p)
+{
+	return p->wcet ? p->wcet : p->required_execution_time;
+}
+
+/** Relative deadline of the task, 0 when it has none. */
+static size_t simos_rt_deadline(simos_process_t *p)
+{
+	return p->deadline ? p->deadline : p->period;
+}
+
+/** Utilisation test of the tasks in the list. */
+int simos_rt_schedulable(simos_list_t *tasks, int policy, double *u)
+{
+	simos_list_node_t *n;
+	simos_process_t *p;
+	double ui, sum = 0.0, prod = 1.0;
+
+	SIMOS_LIST_FOREACH(n, tasks) {
+		p = simos_node_to_process(n);
+		if (simos_rt_deadline(p) == 0) {
+			continue; // no deadline, no demand to meet
+		}
+		ui = (double) simos_rt_wcet(p) / simos_rt_deadline(p);
+		sum += ui;
+		prod *= ui + 1.0;
+	}
+
+	*u = sum;
+	if (policy == SIMOS_RT_EDF) {
+		return sum <= 1.0;
+	}
+
+	return prod <= 2.0;
+}
+
+/** Key of a job in the ready heap. */
+static size_t simos_rt_key(simos_process_t *p, int policy)
+{
+	if (policy == SIMOS_RT_RM) {
+		return p->period ? p->period : (size_t) -1;
+	}
+
+	return p->abs_deadline;
+}
+
+/** Release the next job of the task. */
+static void simos_rt_release(simos_process_t *p, size_t now)
+{
+	if (p->job_left) {
+		/* the previous job overran into this one */
+		p->deadline_misses++;
+	}
+
+	p->release = now;
+	p->job_left += simos_rt_wcet(p);
+	p->abs_deadline = simos_rt_deadline(p)
+		? now + simos_rt_deadline(p) : (size_t) -1;
+}
+
+/** Timer of the next release of a real-time task. */
+typedef struct simos_rt_task {
+	simos_timer_t timer;
+	simos_list_node_t *node;
+	/** Time it fired, in the list of the releases due. */
+	size_t due;
+	struct simos_rt_task *next;
+	struct simos_rt_task **released;
+} simos_rt_task_t;
+
+/**
+ * The release is due. It is taken by the policy between two ticks, so
+ * a job ending on this tick is done before the next one comes.
+ */
+static void simos_rt_fire(void *arg, size_t now)
+{
+	simos_rt_task_t *task = (simos_rt_task_t *) arg;
+
+	task->due = now;
+	task->next = *task->released;
+	*task->released = task;
+}
+
+static void simos_run_rt(simos_list_t *ready, simos_list_t *finished,
+		simos_scheduler_conf_t *conf, size_t *simostime, int policy)
+{
+	simos_list_node_t *n, *curr = NULL;
+	simos_process_t *p;
+	simos_rt_task_t *task, *released = NULL;
+	simos_wheel_t *wheel;
+	simos_heap_t *jobs = simos_heap_new();
+	size_t next, pending = 0, njobs = 0, misses = 0;
+	double u;
+
+	/* releases go on the timers of the system, if it has them */
+	wheel = conf->timers ? conf->timers : simos_wheel_new(*simostime);
+
+	simos_current = NULL;
+	srand(time(NULL));
+
+	if (simos_rt_schedulable(ready, policy, &u)) {
+		printf("[ U = %.3f, schedulable ]\n", u);
+	} else {
+		printf("[ U = %.3f, %s ]\n", u, policy == SIMOS_RT_EDF
+				? "not schedulable" : "schedulability unknown");
+	}
+
+	while (1) {
+		/* tasks join at their arrival time */
+		while ((n = simos_list_del_head(ready)) != NULL) {
+			n->next = n->prev = NULL;
+			p = simos_node_to_process(n);
+			p->entry_time = *simostime;
+			p->job_left = 0;
+
+			task = malloc(sizeof(simos_rt_task_t));
+			task->node = n;
+			task->released = &released;
+			simos_timer_init(&task->timer, &simos_rt_fire, task);
+			simos_wheel_add(wheel, &task->timer,
+					p->arrival_time > *simostime
+					? p->arrival_time : *simostime);
+			pending++;
+		}
+
+		/* due releases */
+		simos_wheel_advance(wheel, *simostime);
+		while ((task = released) != NULL) {
+			released = task->next;
+			pending--;
+
+			n = task->node;
+			p = simos_node_to_process(n);
+			if (p->job_left == 0 && n != curr) {
+				simos_rt_release(p, task->due);
+				simos_heap_push(jobs, simos_rt_key(p, policy), n);
+			} else {
+				/* still queued or running, the key is kept */
+				simos_rt_release(p, task->due);
+			}
+
+			if (p->period == 0 || task->due + p->period >= conf->rt_horizon) {
+				free(task);
+				continue;
+			}
+			next = task->due + p->period;
+			if (p->sporadic) {
+				next += rand() % p->period;
+			}
+			simos_wheel_add(wheel, &task->timer, next);
+			pending++;
+		}
+
+		/* preemption by a more urgent job */
+		if (curr && ! simos_heap_empty(jobs)
+				&& simos_heap_top(jobs)->key
+				< simos_rt_key(simos_node_to_process(curr), policy)) {
+			p = simos_node_to_process(curr);
+			simos_preempt(p, simostime);
+			printf("Need %4d time. Running at %4d. [ Preempted ]\n",
+					(int) p->job_left, (int) p->running_time);
+			simos_heap_push(jobs, simos_rt_key(p, policy), curr);
+			curr = NULL;
+		}
+
+		if (curr == NULL) {
+			if (simos_heap_empty(jobs)) {
+				if (pending == 0) {
+					break;
+				}
+				/* idle until the next release */
+				simos_idle(conf, simostime, simos_wheel_next(wheel));
+				continue;
+			}
+
+			curr = simos_heap_pop(jobs);
+			p = simos_node_to_process(curr);
+			printf("Current time is: %6ld - ", *simostime);
+			simos_dispatch(conf, p, simostime);
+			printf("Process %2d. Deadline %6ld. ", p->pid,
+					(long) p->abs_deadline);
+		}
+
+		p = simos_node_to_process(curr);
+		(*simostime)++;
+		p->running_time++;
+		p->job_left--;
+		simos_scheduler_tick(conf, p, simostime);
+
+		if (p->job_left == 0) {
+			p->jobs++;
+			if (*simostime > p->abs_deadline) {
+				p->deadline_misses++;
+				printf("[ Deadline missed ] ");
+			}
+			simos_preempt(p, simostime);
+			printf("Running at %4d. [ Job %d done ]",
+					(int) p->running_time, (int) p->jobs);
+
+			/* no release ahead: the task is over */
+			if (p->period == 0 || p->release + p->period >= conf->rt_horizon) {
+				printf("[ Finished at %4d ]", (int) p->running_time);
+				p->out_time = *simostime;
+				p->turnaround_time = p->out_time - p->entry_time;
+				simos_list_add(finished, curr);
+				njobs += p->jobs;
+				misses += p->deadline_misses;
+			}
+			printf("\n");
+			curr = NULL;
+		}
+	}
+
+	printf("[ %d jobs, %d deadline misses ]\n", (int) njobs, (int) misses);
+
+	simos_heap_free(jobs);
+	if (wheel != conf->timers) {
+		simos_wheel_free(wheel);
+	}
+}
+
+void simos_run_edf(simos_list_t *ready, simos_list_t *finished,
+		simos_scheduler_conf_t *conf, size_t *simostime)
+{
+	simos_run_rt(ready, finished, conf, simostime, SIMOS_RT_EDF);
+}
+
+void simos_run_rm(simos_list_t *ready, simos_list_t *finished,
+		simos_scheduler_conf_t *conf, size_t *simostime)
+{
+	simos_run_rt(ready, finished, conf, simostime, SIMOS_RT_RM);
+}
+
+/*****************************************************************
+ * Priority with aging
+ *
+ * A process waiting aging_interval units of time goes one priority up.
+ * Instead of raising every waiting process on every tick, a process is
+ * queued by the time it reaches the top priority,
+ *     key = enqueue time + priority * aging_interval,
+ * and the smallest key runs next. Keys go into SIMOS_AGING_BUCKETS
+ * lists, aging_interval wide, used as a ring from the bucket of the
+ * smallest key (the epoch); a bit map of the non-empty buckets gives the
+ * next one with a count-trailing-zeros. Queueing and picking are O(1).
+ *
+ * Keys past the ring (large priorities, a small interval, or an epoch
+ * left behind by processes waiting long) go to an overflow list, moved
+ * into the ring once the epoch gets close enough to the smallest of them.
+ ****************************************************************/
+#define SIMOS_AGING_BUCKETS 64
+
+typedef struct {
+	simos_list_t *bucket[SIMOS_AGING_BUCKETS];
+	unsigned long nonempty;
+	/** Bucket of the smallest key, in units of aging_interval. */
+	size_t epoch;
+	size_t width;
+	/** Keys past the ring, and the bucket of the smallest of them. */
+	simos_list_t *overflow;
+	size_t overflow_min;
+} simos_aging_t;
+
+/** Put `n' in the bucket of its key, or in the overflow past the ring. */
+static void simos_aging_place(simos_aging_t *q, simos_list_node_t *n)
+{
+	size_t slot = simos_node_to_process(n)->aging_key / q->width;
+	int i;
+
+	if (slot < q->epoch) {
+		slot = q->epoch; // already due
+	}
+
+	n->next = n->prev = NULL;
+	if (slot >= q->epoch + SIMOS_AGING_BUCKETS) {
+		if (simos_list_empty(q->overflow) || slot < q->overflow_min) {
+			q->overflow_min = slot;
+		}
+		simos_list_add(q->overflow, n);
+		return;
+	}
+
+	i = slot % SIMOS_AGING_BUCKETS;
+	simos_list_add(q->bucket[i], n);
+	q->nonempty |= 1UL << i;
+}
+
+/** Move the keys of the overflow the ring reaches now into it. */
+static void simos_aging_refill(simos_aging_t *q)
+{
+	simos_list_node_t *n, *next;
+	simos_list_t *rest;
+
+	if (simos_list_empty(q->overflow)
+			|| q->overflow_min >= q->epoch + SIMOS_AGING_BUCKETS) {
+		return;
+	}
+
+	rest = q->overflow;
+	q->overflow = simos_list_new();
+	for (n = rest->head; n; n = next) {
+		next = n->next;
+		simos_aging_place(q, n);
+	}
+	free(rest);
+}
+
+/** Queue `n' by `key', no less than `now'. */
+static void simos_aging_push(simos_aging_t *q, simos_list_node_t *n,
+		size_t key, size_t now)
+{
+	simos_node_to_process(n)->aging_key = key;
+
+	if (! q->nonempty && simos_list_empty(q->overflow)) {
+		q->epoch = now / q->width;
+	}
+
+	simos_aging_place(q, n);
+}
+
+static simos_list_node_t *simos_aging_pop(simos_aging_t *q)
+{
+	simos_list_node_t *n;
+	unsigned long ring;
+	int i, shift;
+
+	if (! q->nonempty) {
+		if (simos_list_empty(q->overflow)) {
+			return NULL;
+		}
+		/* the ring is empty: jump to the overflow */
+		q->epoch = q->overflow_min;
+		simos_aging_refill(q);
+	}
+
+	/* rotate the bit map so the epoch comes first */
+	shift = q->epoch % SIMOS_AGING_BUCKETS;
+	ring = shift ? (q->nonempty >> shift)
+		| (q->nonempty << (SIMOS_AGING_BUCKETS - shift)) : q->nonempty;
+	q->epoch += __builtin_ctzl(ring);
+	simos_aging_refill(q);
+
+	i = q->epoch % SIMOS_AGING_BUCKETS;
+	n = simos_list_del_head(q->bucket[i]);
+	n->next = n->prev = NULL;
+	if (simos_list_empty(q->bucket[i])) {
+		q->nonempty &= ~(1UL << i);
+	}
+
+	return n;
+}
+
+void simos_run_aging(simos_list_t *ready, simos_list_t *finished,
+		simos_scheduler_conf_t *conf, size_t *simostime)
+{
+	simos_list_node_t *n;
+	simos_process_t *p;
+
+	simos_aging_t q;
+	size_t prio;
+	int i;
+
+	for (i = 0; i < SIMOS_AGING_BUCKETS; i++) {
+		q.bucket[i] = simos_list_new();
+	}
+	q.nonempty = 0;
+	q.epoch = 0;
+	q.width = conf->aging_interval ? conf->aging_interval : 1;
+	q.overflow = simos_list_new();
+	q.overflow_min = 0;
+
+	simos_current = NULL;
+	srand(time(NULL));
+
+	while (1) {
+		while ((n = simos_list_del_head(ready)) != NULL) {
+			p = simos_node_to_process(n);
+			p->entry_time = *simostime;
+			(*simostime)++;
+
+			if (conf->priority) {
+				p->priority = rand() % 6; //6 Priority: 0-5
+			}
+			simos_aging_push(&q, n, *simostime + p->priority
+					* conf->aging_interval, *simostime);
+		}
+
+		if ((n = simos_aging_pop(&q)) == NULL) {
+			break;
+		}
+		p = simos_node_to_process(n);
+		prio = p->priority < 5 ? p->priority : 5;
+
+		printf("Current time is: %6ld - ", *simostime);
+		printf("Process %2d. Priority %1d. ", p->pid, (int) p->priority);
+		simos_run_slice(conf, p, 20 * (6 - prio), simostime);
+
+		if (! simos_finish(finished, n, simostime)) {
+			simos_aging_push(&q, n, *simostime + p->priority
+					* conf->aging_interval, *simostime);
+		}
+		printf("\n");
+	}
+
+	for (i = 0; i < SIMOS_AGING_BUCKETS; i++) {
+		free(q.bucket[i]);
+	}
+	free(q.overflow);
+}
+
+/*****************************************************************
+ * Round-Robin with I/O
+ *
+ * A process alternates CPU and I/O bursts. At the end of a CPU burst it
+ * blocks in the queue of its device and leaves the CPU to the others;
+ * the completion of the request brings it back to the ready queue. With
+ * nobody ready the CPU idles until the next completion.
+ ****************************************************************/
+
+/** Start a new CPU burst, the whole job if the process does no I/O. */
+static void simos_cpu_burst(simos_process_t *p)
+{
+	size_t len = simos_process_draw(p, p->cpu_burst);
+
+	p->burst_start = p->running_time;
+	p->burst_left = p->required_execution_time - p->running_time;
+	if (len && len < p->burst_left) {
+		p->burst_left = len;
+	}
+}
+
+/** Bring back to the ready queue every process whose I/O is over. */
+static void simos_io_wakeup(simos_scheduler_conf_t *conf, simos_list_t *ready,
+		size_t now)
+{
+	simos_list_node_t *n;
+
+	while ((n = simos_io_complete(conf->io, now)) != NULL) {
+		simos_cpu_burst(simos_node_to_process(n));
+		simos_list_add(ready, n);
+	}
+}
+
+void simos_run_io(simos_list_t *ready, simos_list_t *finished,
+		simos_scheduler_conf_t *conf, size_t *simostime)
+{
+	simos_list_node_t *n;
+	simos_process_t *p;
+
+	simos_disk_t *disk;
+	size_t start, idle = 0, slice, done = 0;
+	int i;
+
+	simos_current = NULL;
+	SIMOS_LIST_FOREACH(n, ready) {
+		p = simos_node_to_process(n);
+		p->entry_time = *simostime;
+		p->io_time = 0;
+		p->state = SIMOS_READY;
+		simos_cpu_burst(p);
+		(*simostime)++;
+	}
+	start = *simostime;
+
+	while (1) {
+		if (conf->io) {
+			simos_io_wakeup(conf, ready, *simostime);
+		}
+
+		if (simos_list_empty(ready)) {
+			if (conf->io == NULL || conf->io->pending == 0) {
+				break;
+			}
+
+			/* everybody is blocked: idle until a request is over */
+			idle += simos_io_next(conf->io) - *simostime;
+			simos_idle(conf, simostime, simos_io_next(conf->io));
+			continue;
+		}
+
+		n = simos_list_del_head(ready);
+		n->next = n->prev = NULL;
+		p = simos_node_to_process(n);
+		p->state = SIMOS_RUNNING;
+
+		printf("Current time is: %6ld - ", *simostime);
+		printf("Process %2d. Quantum %1d. ", p->pid, (int) p->quantum);
+
+		slice = 50 * p->quantum; //Int 50Hz * quantum
+		if (slice > p->burst_left) {
+			slice = p->burst_left;
+		}
+		p->burst_left -= simos_run_slice(conf, p, slice, simostime);
+
+		if (simos_finish(finished, n, simostime)) {
+			p->state = SIMOS_READY;
+			done++;
+		} else if (p->burst_left) {
+			p->state = SIMOS_READY;
+			simos_list_add(ready, n);
+		} else {
+			simos_scheduler_burst(conf, p,
+					p->running_time - p->burst_start);
+			if (conf->io && simos_io_submit(conf->io, n, *simostime)) {
+				printf("[ Blocked on %d ]", p->device);
+			} else {
+				simos_cpu_burst(p);
+				p->state = SIMOS_READY;
+				simos_list_add(ready, n);
+			}
+		}
+		printf("\n");
+	}
+
+	if (*simostime > start) {
+		printf("[ CPU %d%% busy, %d jobs in %d, throughput %.2f/1000 ]\n",
+				(int) (100 * (*simostime - start - idle)
+					/ (*simostime - start)),
+				(int) done, (int) (*simostime - start),
+				1000.0 * done / (*simostime - start));
+	}
+
+	for (i = 0; conf->io && i < conf->io->ndev; i++) {
+		printf("[ Device %d: %d requests, %d%% busy ]", i,
+				(int) conf->io->dev[i].requests,
+				(int) (100 * conf->io->dev[i].busy_time
+					/ (*simostime - start + 1)));
+
+		disk = conf->io->dev[i].disk;
+		if (disk && disk->requests) {
+			printf("[ Disk: mean seek %d cylinders, wait %d, "
+					"service %d ]",
+					(int) (disk->seek_distance / disk->requests),
+					(int) (disk->wait_time / disk->requests),
+					(int) (disk->service_time / disk->requests));
+		}
+		printf("\n");
+	}
+
+	if (conf->io && conf->io->fs) {
+		printf("[ Buffer cache: %d hits, %d misses, %d written back "
+				"in %d batches ]\n",
+				(int) conf->io->fs->hits, (int) conf->io->fs->misses,
+				(int) conf->io->fs->writebacks,
+				(int) conf->io->fs->batches);
+	}
+}
+
+/*****************************************************************
+ * Priority scheduling with mutual exclusion
+ *
+ * The highest priority ready process runs, a more urgent one arriving
+ * or woken takes the CPU from it. Every cs_every units of time of CPU a
+ * process enters a critical section holding its lock for cs_len, and
+ * blocks if somebody else holds it. With priority inheritance the holder
+ * runs at the priority of its most urgent waiter, so processes of a
+ * priority in between can not keep both of them off the CPU.
+ ****************************************************************/
+
+/** Highest priority ready process, the first one among equals. */
+static simos_list_node_t *simos_sync_pick(simos_list_t *ready)
+{
+	simos_list_node_t *n, *best = NULL;
+
+	SIMOS_LIST_FOREACH(n, ready) {
+		if (best == NULL || simos_node_to_process(n)->priority
+				< simos_node_to_process(best)->priority) {
+			best = n;
+		}
+	}
+
+	if (best) {
+		simos_list_unlink(ready, best);
+		best->next = best->prev = NULL;
+	}
+	return best;
+}
+
+/** Move the processes arrived by `now' to ready, return the most urgent. */
+static size_t simos_sync_arrive(simos_rb_tree_t *arrivals,
+		simos_list_t *ready, size_t now)
+{
+	simos_rb_node_t *rb;
+	simos_process_t *p;
+	size_t urgent = (size_t) -1;
+
+	while ((rb = simos_rb_first(arrivals)) && rb->key <= now) {
+		simos_rb_del(arrivals, rb);
+		p = simos_node_to_process(rb->data);
+		p->entry_time = now;
+		simos_list_add(ready, rb->data);
+		if (p->priority < urgent) {
+			urgent = p->priority;
+		}
+		free(rb);
+	}
+
+	return urgent;
+}
+
+/** Leave the critical section, return the process the lock went to. */
+static simos_process_t *simos_sync_leave(simos_list_t *ready,
+		simos_process_t *p, size_t now)
+{
+	simos_list_node_t *w = simos_mutex_unlock(p->lock, now);
+
+	p->cs_left = 0;
+	if (w == NULL) {
+		return NULL;
+	}
+
+	simos_node_to_process(w)->cs_left = simos_node_to_process(w)->cs_len;
+	simos_list_add(ready, w);
+	return simos_node_to_process(w);
+}
+
+void simos_run_sync(simos_list_t *ready, simos_list_t *finished,
+		simos_scheduler_conf_t *conf, size_t *simostime)
+{
+	simos_list_node_t *n;
+	simos_process_t *p, *w;
+
+	/* processes yet to arrive, ordered by arrival time */
+	simos_rb_tree_t *arrivals = simos_rb_new();
+	simos_sync_t *lock = NULL;
+	size_t ran, slice, prio, waited = 0, urgent = 0;
+	int r;
+
+	simos_current = NULL;
+	srand(time(NULL));
+
+	while ((n = simos_list_del_head(ready)) != NULL) {
+		n->next = n->prev = NULL;
+		p = simos_node_to_process(n);
+		p->sync_time = 0;
+		p->cs_left = 0;
+		p->state = SIMOS_READY;
+		if (conf->priority) {
+			p->priority = rand() % 6; //6 Priority: 0-5
+		}
+		p->base_priority = p->priority;
+		simos_rb_insert(arrivals, simos_rb_new_node(n, p->arrival_time));
+	}
+
+	while (1) {
+		simos_sync_arrive(arrivals, ready, *simostime);
+		if ((n = simos_sync_pick(ready)) == NULL) {
+			if (simos_rb_empty(arrivals)) {
+				break;
+			}
+			/* idle until the next arrival */
+			simos_idle(conf, simostime, simos_rb_first(arrivals)->key);
+			continue;
+		}
+		p = simos_node_to_process(n);
+		p->state = SIMOS_RUNNING;
+
+		printf("Current time is: %6ld - ", *simostime);
+		printf("Process %2d. Priority %1d. ", p->pid, (int) p->priority);
+
+		slice = 50 * p->quantum; //Int 50Hz * quantum
+		r = 1;
+		simos_dispatch(conf, p, simostime);
+		for (ran = 0; ran < slice
+				&& p->running_time < p->required_execution_time; ran++) {
+			if (p->cs_left == 0 && p->lock && p->cs_every
+					&& p->running_time % p->cs_every == 0) {
+				r = simos_mutex_lock(p->lock, n, *simostime);
+				if (r == 0) {
+					break;
+				}
+				p->cs_left = (r == 1) ? p->cs_len : 0;
+			}
+
+			(*simostime)++;
+			p->running_time++;
+			simos_scheduler_tick(conf, p, simostime);
+
+			prio = p->priority;
+			w = NULL;
+			if (p->cs_left && --p->cs_left == 0) {
+				w = simos_sync_leave(ready, p, *simostime);
+			}
+
+			// preempted by somebody more urgent, or by itself
+			// losing an inherited priority
+			if (simos_sync_arrive(arrivals, ready, *simostime)
+					< p->priority
+					|| (w && w->priority < p->priority)
+					|| p->priority > prio) {
+				break;
+			}
+		}
+		simos_preempt(p, simostime);
+
+		printf("Need %4d time. Running at %4d. ",
+				(int) p->required_execution_time,
+				(int) p->running_time);
+
+		if (r == 0) {
+			printf("[ Blocked on lock ]");
+		} else if (p->running_time >= p->required_execution_time) {
+			if (p->cs_left) {
+				simos_sync_leave(ready, p, *simostime);
+			}
+			p->state = SIMOS_READY;
+			simos_finish(finished, n, simostime);
+		} else {
+			p->state = SIMOS_READY;
+			simos_list_add(ready, n);
+		}
+		printf("\n");
+	}
+
+	SIMOS_LIST_FOREACH(n, finished) {
+		p = simos_node_to_process(n);
+		waited += p->sync_time;
+		if (p->base_priority == 0) {
+			urgent += p->sync_time;
+		}
+		if (p->lock && p->lock != lock) {
+			lock = p->lock;
+			printf("[ Lock: %d acquisitions, %d contentions, "
+					"%d boosts, %d deadlocks ]\n",
+					(int) lock->acquisitions,
+					(int) lock->contentions,
+					(int) lock->boosts, (int) lock->deadlocks);
+		}
+	}
+	printf("[ Blocked on locks for %d, priority 0 for %d ]\n",
+			(int) waited, (int) urgent);
+
+	free(arrivals);
+}
+
+/*****************************************************************
+ * Round-Robin of pipelines
+ *
+ * Processes are stages passing items through bounded channels. A stage
+ * blocks when its output is full or its input empty, and the other end
+ * brings it back to the ready queue: the slowest stage sets the pace.
+ ****************************************************************/
+
+/** Bring back to the ready queue every process done waiting on `c'. */
+static void simos_ipc_wakeup(simos_list_t *ready, simos_chan_t *c,
+		size_t now)
+{
+	simos_list_node_t *n;
+
+	while ((n = simos_chan_wake(c, now)) != NULL) {
+		simos_list_add(ready, n);
+	}
+}
+
+/**
+ * Every ipc_every units of time send the item made and receive the next
+ * one. Return false whether the process blocked.
+ */
+static int simos_ipc_step(simos_list_t *ready, simos_list_node_t *n,
+		size_t now)
+{
+	simos_process_t *p = simos_node_to_process(n);
+	int r;
+
+	if (p->ipc_every == 0 || p->running_time % p->ipc_every) {
+		return 1;
+	}
+
+	if (p->ipc_phase == 0) {
+		p->ipc_phase = 1;
+		if (p->running_time && p->ipc_out) {
+			r = simos_chan_send(p->ipc_out, n, NULL, p->ipc_size, now);
+			simos_ipc_wakeup(ready, p->ipc_out, now);
+			if (r == 0) {
+				return 0;
+			}
+		}
+	}
+
+	if (p->ipc_phase == 1) {
+		p->ipc_phase = 2;
+		if (p->ipc_in) {
+			r = simos_chan_recv(p->ipc_in, n, NULL, p->ipc_size, now);
+			simos_ipc_wakeup(ready, p->ipc_in, now);
+			if (r == 0) {
+				return 0;
+			}
+		}
+	}
+
+	p->ipc_phase = 0;
+	return 1;
+}
+
+/** Add the channel to the ones of the execution, emptied and with no ends. */
+static void simos_ipc_track(simos_chan_t **chans, size_t *nchans,
+		simos_chan_t *c)
+{
+	size_t i;
+
+	for (i = 0; i < *nchans; i++) {
+		if (chans[i] == c) {
+			return;
+		}
+	}
+
+	c->head = 0;
+	c->len = 0;
+	c->readers = 0;
+	c->writers = 0;
+	c->bytes = 0;
+	c->messages = 0;
+	c->send_waits = 0;
+	c->recv_waits = 0;
+	chans[(*nchans)++] = c;
+}
+
+/** Nobody will wake the waiters up: move them to finished. */
+static size_t simos_ipc_deadlocked(simos_list_t *waiters, const char *on,
+		simos_list_t *finished, size_t now)
+{
+	simos_list_node_t *n;
+	simos_process_t *p;
+	size_t count = 0;
+
+	while ((n = simos_list_del_head(waiters)) != NULL) {
+		n->next = n->prev = NULL;
+		p = simos_node_to_process(n);
+		p->state = SIMOS_READY;
+		p->sync_time += now;
+
+		printf("Current time is: %6ld - ", (long) now);
+		printf("Process %2d. Need %4d time. Running at %4d. "
+				"[ Deadlocked on %s ]\n", p->pid,
+				(int) p->required_execution_time,
+				(int) p->running_time, on);
+		p->out_time = now;
+		p->turnaround_time = p->out_time - p->entry_time;
+		simos_list_add(finished, n);
+		count++;
+	}
+
+	return count;
+}
+
+void simos_run_ipc(simos_list_t *ready, simos_list_t *finished,
+		simos_scheduler_conf_t *conf, size_t *simostime)
+{
+	simos_list_node_t *n;
+	simos_process_t *p;
+
+	simos_chan_t *c = NULL, **chans;
+	size_t ran, slice, start, items = 0, waits = 0, waited = 0;
+	size_t nchans = 0, deadlocked = 0, i;
+	int blocked;
+
+	simos_current = NULL;
+	i = 0;
+	SIMOS_LIST_FOREACH(n, ready) {
+		i += 2;
+	}
+	chans = malloc((i ? i : 1) * sizeof(simos_chan_t *));
+
+	SIMOS_LIST_FOREACH(n, ready) {
+		p = simos_node_to_process(n);
+		p->entry_time = *simostime;
+		p->sync_time = 0;
+		p->ipc_phase = 0;
+		p->state = SIMOS_READY;
+		if (p->ipc_in) {
+			simos_ipc_track(chans, &nchans, p->ipc_in);
+			p->ipc_in->readers++;
+		}
+		if (p->ipc_out) {
+			simos_ipc_track(chans, &nchans, p->ipc_out);
+			p->ipc_out->writers++;
+		}
+		(*simostime)++;
+	}
+	start = *simostime;
+
+	while ((n = simos_list_del_head(ready)) != NULL) {
+		n->next = n->prev = NULL;
+		p = simos_node_to_process(n);
+		p->state = SIMOS_RUNNING;
+
+		printf("Current time is: %6ld - ", *simostime);
+		printf("Process %2d. Quantum %1d. ", p->pid, (int) p->quantum);
+
+		slice = 50 * p->quantum; //Int 50Hz * quantum
+		blocked = 0;
+		simos_dispatch(conf, p, simostime);
+		for (ran = 0; ran < slice
+				&& p->running_time < p->required_execution_time; ran++) {
+			if (! simos_ipc_step(ready, n, *simostime)) {
+				blocked = 1;
+				break;
+			}
+			(*simostime)++;
+			p->running_time++;
+			simos_scheduler_tick(conf, p, simostime);
+		}
+		simos_preempt(p, simostime);
+
+		printf("Need %4d time. Running at %4d. ",
+				(int) p->required_execution_time,
+				(int) p->running_time);
+
+		if (blocked) {
+			printf("[ Blocked on %s ]",
+					(p->ipc_phase == 1) ? "send" : "receive");
+		} else if (p->running_time >= p->required_execution_time) {
+			/* the readers get the end of file, the writers an error */
+			if (p->ipc_in) {
+				simos_chan_close(p->ipc_in, 0);
+				simos_ipc_wakeup(ready, p->ipc_in, *simostime);
+			}
+			if (p->ipc_out) {
+				simos_chan_close(p->ipc_out, 1);
+				simos_ipc_wakeup(ready, p->ipc_out, *simostime);
+			}
+			p->state = SIMOS_READY;
+			simos_finish(finished, n, simostime);
+		} else {
+			p->state = SIMOS_READY;
+			simos_list_add(ready, n);
+		}
+		printf("\n");
+	}
+
+	/* a cycle or a missing peer: left waiting on a channel for good */
+	for (i = 0; i < nchans; i++) {
+		deadlocked += simos_ipc_deadlocked(chans[i]->senders, "send",
+				finished, *simostime);
+		deadlocked += simos_ipc_deadlocked(chans[i]->receivers, "receive",
+				finished, *simostime);
+	}
+	free(chans);
+
+	SIMOS_LIST_FOREACH(n, finished) {
+		p = simos_node_to_process(n);
+		waited += p->sync_time;
+		if (p->ipc_out && p->ipc_out != c) {
+			c = p->ipc_out;
+			waits += c->send_waits + c->recv_waits;
+		}
+		// the last stage of a pipeline
+		if (p->ipc_in && p->ipc_out == NULL) {
+			items += p->ipc_in->messages;
+		}
+	}
+
+	if (*simostime > start) {
+		printf("[ %d items out of the pipelines, throughput %.2f/1000, "
+				"%d waits on channels for %d, %d deadlocked ]\n",
+				(int) items, 1000.0 * items / (*simostime - start),
+				(int) waits, (int) waited, (int) deadlocked);
+	}
+}
@@ -35,9 +35,48 @@ simos_t *simos_new(size_t memory_size)
 
 	s->sched = simos_scheduler_new();
 	s->mem = simos_memory_create(memory_size);
+	s->pending = simos_list_new();
+	s->paging = NULL;
+	s->cache = NULL;
+	s->io = NULL;
+	s->timers = simos_wheel_new(1);
+	s->bank = NULL;
+	s->swap = NULL;
+	s->numa = NULL;
+	s->groups = NULL;
+	s->dvfs = NULL;
 	return s;
 }
 
+/** Cells for the process' block, -1 if they are not found. */
+static size_t simos_place(simos_t *simos, simos_process_t *proc, size_t now)
+{
+	size_t pointer;
+
+	if (simos->numa) {
+		/* the policy picks the nodes, others are swapped out until it fits */
+		do {
+			pointer = simos_numa_alloc(simos->numa, simos->mem, proc,
+					proc->required_memory);
+		} while (pointer == (size_t) -1 && simos->swap
+				&& simos_swap_evict(simos->swap, simos->mem, NULL, now));
+		return pointer;
+	}
+	if (simos->swap) {
+		/* overcommit: others make room on the swap file */
+		return simos_swap_alloc(simos->swap, simos->mem,
+				proc->required_memory, NULL, now);
+	}
+	return p_simos_memory_alloc(simos->mem, proc->required_memory);
+}
+
+/** Whether the process was given memory, in cells, pages or swap. */
+static int simos_has_memory(simos_process_t *proc)
+{
+	return proc->memory_pointer != (size_t) -1 || proc->pt
+		|| proc->swap_slot != (size_t) -1;
+}
+
 /** Add a process to the scheduler. */
 int simos_add_process(simos_t *simos, simos_process_t *proc,
 		simos_memory_conf_t *mconf)
@@ -50,19 +89,275 @@ int simos_add_process(simos_t *simos, simos_process_t *proc,
 		p_simos_memory_alloc = simos_memory_alloc;
 	}
 
-	size_t pointer = p_simos_memory_alloc(simos->mem,
-				proc->required_memory);
+	size_t pointer;
+	simos_memory_compact_t *c = simos->mem->compact;
+
+	/* a pending process keeps its claim, a dropped one gives it back */
+	if (simos->bank) {
+		simos_bank_admit(simos->bank, proc, NULL);
+	}
+
+	if (proc->leader != proc) {
+		/* a thread waits for the memory of its process, if it has to */
+		if (! simos_has_memory(proc->leader)) {
+			simos_list_add(simos->pending, simos_list_new_node(proc));
+			return 0;
+		}
+		simos_process_list_add(simos->sched->ready, proc);
+		return 1;
+	}
+
+	if (mconf->paging && simos->paging) {
+		/* pages are brought in on demand */
+		simos_paging_add_process(simos->paging, proc);
+		simos_process_list_add(simos->sched->ready, proc);
+		return 1;
+	}
+
+	if (proc->group && ! simos_group_charge(proc->group,
+				proc->required_memory)) {
+		/* over the memory limit of its group: dropped */
+		if (simos->bank) {
+			simos_bank_leave(simos->bank, proc);
+		}
+		return 0;
+	}
+
+	if (mconf->compact && c) {
+		if (c->running) {
+			/* nothing is placed until the compaction is over */
+			simos_list_add(simos->pending, simos_list_new_node(proc));
+			return 0;
+		}
+	}
+
+	pointer = simos_place(simos, proc, simostime);
 
 	if (pointer == -1) {
+		if (mconf->compact && c) {
+			simos_list_add(simos->pending, simos_list_new_node(proc));
+			simos_memory_compact_add(simos->mem, simos->sched->ready);
+			simos_memory_compact_start(simos->mem);
+		} else {
+			/* dropped: no room and no compaction to make it */
+			if (proc->group) {
+				simos_group_uncharge(proc->group, proc->required_memory);
+			}
+			if (simos->bank) {
+				simos_bank_leave(simos->bank, proc);
+			}
+		}
 		return 0;
 	}
 
 	proc->memory_pointer = pointer;
+	if (simos->swap) {
+		simos_swap_add(simos->swap, proc);
+	}
 	simos_process_list_add(simos->sched->ready, proc);
 
 	return 1;
 }
 
+simos_process_t *simos_fork(simos_t *simos, simos_process_t *parent, int pid,
+		simos_memory_conf_t *mconf)
+{
+	simos_process_t *child = simos_process_create(pid,
+			parent->required_execution_time, parent->required_memory);
+
+	child->group = parent->group;
+
+	if (mconf->paging && simos->paging && parent->pt) {
+		if (simos->bank) {
+			simos_bank_admit(simos->bank, child, NULL);
+		}
+		simos_paging_fork(simos->paging, parent, child);
+		simos_process_list_add(simos->sched->ready, child);
+		return child;
+	}
+
+	child->numa_node = parent->numa_node;
+	simos_add_process(simos, child, mconf);
+	return child;
+}
+
+/** Try to admit the pending processes. Return how many were admitted. */
+int simos_admit_pending(simos_t *simos, size_t now)
+{
+	simos_list_node_t *n, *next;
+	simos_process_t *p;
+	size_t pointer;
+	int admitted = 0;
+
+	for (n = simos->pending->head; n; n = next) {
+		next = n->next;
+		p = simos_node_to_process(n);
+
+		if (p->leader != p) {
+			/* in with its process, which is ahead in the list */
+			if (! simos_has_memory(p->leader)) {
+				continue;
+			}
+			pointer = -1;
+		} else {
+			pointer = simos_place(simos, p, now);
+			if (pointer == -1) {
+				continue;
+			}
+		}
+
+		simos_list_del(simos->pending, n);
+		n->next = n->prev = NULL;
+
+		p->memory_pointer = pointer;
+		p->entry_time = now;
+		if (simos->swap && p->leader == p) {
+			simos_swap_add(simos->swap, p);
+		}
+		simos_list_add(simos->sched->ready, n);
+		admitted++;
+	}
+
+	return admitted;
+}
+
+/** Timer firing at time `expires' of the current execution. */
+void simos_timer_add(simos_t *simos, simos_timer_t *t, size_t expires)
+{
+	simos_wheel_add(simos->timers, t, expires);
+}
+
+/** Cancel a pending timer. Return true or false. */
+int simos_timer_cancel(simos_t *simos, simos_timer_t *t)
+{
+	return simos_wheel_del(simos->timers, t);
+}
+
+/** A step of the compaction, the pending processes come in once over. */
+static void simos_compact_tick(simos_t *simos, size_t *simostime)
+{
+	simos_memory_compact_t *c = simos->mem->compact;
+
+	(*simostime) += simos_memory_compact_step(simos->mem);
+
+	if (! c->running) {
+		printf("[ Compaction: %d bytes moved, cost %d ] ",
+				(int) c->bytes_moved, (int) c->cost);
+		simos_admit_pending(simos, *simostime);
+	}
+}
+
+/** Resizes of the process, within the memory limit of its group. */
+static size_t simos_heap_tick(simos_t *simos, simos_process_t *proc)
+{
+	size_t len, old, now, charged = 0, cost;
+	int map;
+
+	if (! simos_memory_heap_request(simos->mem, proc, &map, &len)) {
+		return 0;
+	}
+	if (proc->group == NULL) {
+		return simos_memory_heap_resize(simos->mem, proc, map, len);
+	}
+
+	/* the growth is charged first, a refused one moves no cell */
+	old = map ? proc->mmap_len : proc->required_memory;
+	if (len > old) {
+		if (! simos_group_charge(proc->group, len - old)) {
+			return 0;
+		}
+		charged = len - old;
+	}
+
+	cost = simos_memory_heap_resize(simos->mem, proc, map, len);
+
+	/* what was given back, or charged but did not fit */
+	now = map ? proc->mmap_len : proc->required_memory;
+	if (old + charged > now) {
+		simos_group_uncharge(proc->group, old + charged - now);
+	}
+	return cost;
+}
+
+/** Work done by the system on every tick a process holds the CPU. */
+static void simos_tick(void *arg, simos_process_t *proc, size_t *simostime)
+{
+	simos_t *simos = (simos_t *) arg;
+	simos_memory_compact_t *c = simos->mem->compact;
+	simos_process_t *mm = proc;
+
+	simos_memory_stats_sample(simos->mem, *simostime);
+	simos_wheel_advance(simos->timers, *simostime);
+
+	if (proc && proc->leader != proc) {
+		/* the memory work is done on the address space of the process */
+		mm = proc->leader;
+		mm->last_run = *simostime;
+	}
+
+	if (simos->dvfs && proc) {
+		(*simostime) += simos_dvfs_tick(simos->dvfs, proc, *simostime);
+	}
+
+	if (simos->swap) {
+		/* a swapped out process cannot come in while compacting */
+		while (mm && mm->swap_slot != (size_t) -1 && c && c->running) {
+			simos_compact_tick(simos, simostime);
+		}
+		(*simostime) += simos_swap_tick(simos->swap, simos->mem, mm,
+				*simostime);
+	}
+
+	if (simos->paging && mm && mm->pt) {
+		(*simostime) += simos_paging_tick(simos->paging, mm);
+	}
+
+	if (simos->cache && mm) {
+		(*simostime) += simos_cache_tick(simos->cache, mm);
+	}
+
+	if (simos->numa && mm && mm->pt == NULL) {
+		(*simostime) += simos_numa_tick(simos->numa, mm);
+	}
+
+	if (simos->mem->heap && mm && mm->pt == NULL
+			&& mm->swap_slot == (size_t) -1) {
+		(*simostime) += simos_heap_tick(simos, mm);
+	}
+
+	if (simos->bank && proc) {
+		simos_bank_tick(simos->bank, proc);
+	}
+
+	if (c && c->running) {
+		simos_compact_tick(simos, simostime);
+	}
+}
+
+/** CPU and memory of the group and the ones below, indented by depth. */
+static void simos_group_report(simos_group_t *g, int depth)
+{
+	simos_group_t *root = g, *c;
+
+	while (root->parent) {
+		root = root->parent;
+	}
+
+	printf("[ Group %*s%-6s: ", depth * 2, "", g->name);
+	if (root->cpu_time) {
+		/* only the CFS policy runs the processes by group */
+		printf("%6d of CPU (%5.1f%%), throttled %d times; ",
+				(int) g->cpu_time, 100.0 * g->cpu_time / root->cpu_time,
+				(int) g->throttles);
+	}
+	printf("memory %d, peak %d, %d refused ]\n", (int) g->mem_usage,
+			(int) g->mem_peak, (int) g->mem_failures);
+
+	for (c = g->child; c; c = c->sibling) {
+		simos_group_report(c, depth + 1);
+	}
+}
+
 /** Execute the simulation... */
 void simos_execute(simos_t *simos, simos_scheduler_conf_t *conf,
 		int algorithm)
@@ -70,7 +365,11 @@ void simos_execute(simos_t *simos, simos_scheduler_conf_t *conf,
 	simos_list_t *ready, *finished;
 	simos_list_node_t *n;
 	simos_process_t *p;
-	char fname[30], algname[5];
+	char fname[40], algname[10];
+	size_t switches = 0, switch_time = 0;
+	size_t resident = 0, shared = 0, r, sh;
+	size_t procs = 0, threads = 0, turnaround = 0, work = 0, energy;
+	int i, j, leaders = 0;
 
 	FILE *f;
 
@@ -78,6 +377,54 @@ void simos_execute(simos_t *simos, simos_scheduler_conf_t *conf,
 	finished = simos_list_new();
 
 	simostime = 1;
+	simos_memory_stats_reset(simos->mem);
+	if (simos->paging) {
+		simos->paging->accesses = 0;
+		simos->paging->tlb_misses = 0;
+		simos->paging->faults = 0;
+		simos->paging->evictions = 0;
+		simos->paging->cow_copies = 0;
+	}
+	if (simos->cache) {
+		simos_cache_flush(simos->cache);
+	}
+	if (simos->bank) {
+		simos_bank_reset(simos->bank);
+	}
+	if (simos->numa) {
+		simos_numa_reset(simos->numa);
+	}
+	if (simos->groups) {
+		simos_group_reset(simos->groups);
+	}
+	if (simos->dvfs) {
+		simos_dvfs_reset(simos->dvfs, simostime);
+	}
+	SIMOS_LIST_FOREACH(n, ready) {
+		p = simos_node_to_process(n);
+		p->threads_time = 0;
+		p->done_time = 0;
+		p->energy = 0;
+	}
+	if (simos->mem->heap) {
+		simos->mem->heap->resizes = 0;
+		simos->mem->heap->in_place = 0;
+		simos->mem->heap->relocations = 0;
+		simos->mem->heap->failures = 0;
+		simos->mem->heap->bytes_moved = 0;
+	}
+
+	if (simos->io) {
+		simos_io_reset(simos->io);
+	}
+	/* every execution starts its clock again, timers left are dropped */
+	simos_wheel_reset(simos->timers, simostime);
+
+	conf->tick = &simos_tick;
+	conf->tick_arg = simos;
+	conf->io = simos->io;
+	conf->groups = simos->groups;
+	conf->timers = simos->timers;
 
 	//Schedule algorithms
 	switch(algorithm) {
@@ -103,6 +450,56 @@ void simos_execute(simos_t *simos, simos_scheduler_conf_t *conf,
 			simos_run_queue(ready, finished, conf, &simostime);
 			break;
 
+		case 6:
+			strcpy(algname, "_mlfq_");
+			simos_run_mlfq(ready, finished, conf, &simostime);
+			break;
+
+		case 7:
+			strcpy(algname, "_cfs_");
+			simos_run_cfs(ready, finished, conf, &simostime);
+			break;
+
+		case 8:
+			strcpy(algname, "_lottery_");
+			simos_run_lottery(ready, finished, conf, &simostime);
+			break;
+
+		case 9:
+			strcpy(algname, "_stride_");
+			simos_run_stride(ready, finished, conf, &simostime);
+			break;
+
+		case 10:
+			strcpy(algname, "_edf_");
+			simos_run_edf(ready, finished, conf, &simostime);
+			break;
+
+		case 11:
+			strcpy(algname, "_rm_");
+			simos_run_rm(ready, finished, conf, &simostime);
+			break;
+
+		case 12:
+			strcpy(algname, "_aging_");
+			simos_run_aging(ready, finished, conf, &simostime);
+			break;
+
+		case 13:
+			strcpy(algname, "_io_");
+			simos_run_io(ready, finished, conf, &simostime);
+			break;
+
+		case 14:
+			strcpy(algname, "_sync_");
+			simos_run_sync(ready, finished, conf, &simostime);
+			break;
+
+		case 15:
+			strcpy(algname, "_ipc_");
+			simos_run_ipc(ready, finished, conf, &simostime);
+			break;
+
 	}
 
 	strcpy(fname, "./out");
@@ -113,24 +510,211 @@ void simos_execute(simos_t *simos, simos_scheduler_conf_t *conf,
 
 
 
+	/* the process of each thread, only whether there are threads */
+	SIMOS_LIST_FOREACH(n, finished) {
+		p = simos_node_to_process(n);
+		if (p->leader != p) {
+			leaders = 1;
+		}
+	}
+
 	f = fopen(fname, "w+");
-	fprintf(f, "pid;entry time;out time;required execution time;turnaround_time\n");
+	fprintf(f, "pid;entry time;out time;required execution time;turnaround_time");
+	if (leaders) {
+		fprintf(f, ";process");
+	}
+	fprintf(f, simos->dvfs ? ";energy\n" : "\n");
 	SIMOS_LIST_FOREACH(n, finished) {
 		p = simos_node_to_process(n);
-		fprintf(f, "%d;%d;%d;%d;%d\n", p->pid, (int) p->entry_time,
+		fprintf(f, "%d;%d;%d;%d;%d", p->pid, (int) p->entry_time,
 				(int) p->out_time, (int) p->required_execution_time,
 				(int) p->turnaround_time);
+		if (leaders) {
+			fprintf(f, ";%d", p->leader->pid);
+		}
+		if (simos->dvfs) {
+			fprintf(f, ";%d", (int) p->energy);
+		}
+		fprintf(f, "\n");
+		work += p->required_execution_time;
+
+		/* the process is done when the last of its threads is */
+		p->leader->threads_time += p->required_execution_time;
+		if (p->out_time > p->leader->done_time) {
+			p->leader->done_time = p->out_time;
+		}
 
 		//Clean finished process
 		//simos_memory_free(simos->mem, p->memory_pointer,
 				//p->required_memory);
 
+		switches += p->switches;
+		switch_time += p->switch_time;
+
+		if (simos->paging) {
+			simos_paging_footprint(simos->paging, p, &r, &sh);
+			resident += r;
+			shared += sh;
+		}
+
+		// no I/O: the whole job was a single CPU burst
+		if (p->cpu_burst == 0) {
+			simos_scheduler_burst(conf, p, p->required_execution_time);
+		}
+
 		p->quantum = 1;
 		p->priority = 0;
 		p->running_time = 0;
+		p->last_run = 0;
+		p->vruntime = 0;
+		p->pass = 0;
+		p->jobs = 0;
+		p->deadline_misses = 0;
+		p->switches = 0;
+		p->switch_time = 0;
+		p->arrival_time = 0;
+		p->lock = NULL;
+		p->ipc_in = NULL;
+		p->ipc_out = NULL;
 	}
 	fclose(f);
 
+	printf("[ %d context switches costing %d ]\n", (int) switches,
+			(int) switch_time);
+
+	SIMOS_LIST_FOREACH(n, finished) {
+		p = simos_node_to_process(n);
+		if (p->leader == p) {
+			procs++;
+			threads += p->nthreads;
+			turnaround += p->done_time - p->entry_time;
+		}
+	}
+	if (procs && threads > procs) {
+		printf("[ Threads: %d processes of %d threads, turnaround %d "
+				"on average per process ]\n", (int) procs, (int) threads,
+				(int) (turnaround / procs));
+	}
+
+	if (simos->paging) {
+		printf("[ Paging: %d accesses, %d TLB misses, %d faults, "
+				"%d evictions ]\n",
+				(int) simos->paging->accesses,
+				(int) simos->paging->tlb_misses,
+				(int) simos->paging->faults,
+				(int) simos->paging->evictions);
+		printf("[ Footprint: %d pages resident, %d of them shared, "
+				"in %d frames; %d copies on write ]\n",
+				(int) resident, (int) shared,
+				(int) (simos->paging->nframes - simos->paging->free.len),
+				(int) simos->paging->cow_copies);
+	}
+
+	if (simos->cache) {
+		for (i = 0; i < simos->cache->nlevels; i++) {
+			printf("[ L%d: %d hits, %d misses ]", i + 1,
+					(int) simos->cache->level[i].hits,
+					(int) simos->cache->level[i].misses);
+		}
+		printf("\n");
+	}
+
+	if (simos->mem->heap) {
+		printf("[ Heap: %d resizes, %d grown in place, %d relocated "
+				"(%d bytes), %d refused; fragmentation %.2f ]\n",
+				(int) simos->mem->heap->resizes,
+				(int) simos->mem->heap->in_place,
+				(int) simos->mem->heap->relocations,
+				(int) simos->mem->heap->bytes_moved,
+				(int) simos->mem->heap->failures,
+				simos_memory_fragmentation(simos->mem));
+	}
+
+	if (simos->swap) {
+		/* the device clock starts again with the next execution */
+		simos_swap_drain(simos->swap);
+		printf("[ Swap: %d out, %d in (%d from the swap cache, %d ahead "
+				"of time), %d cells written and %d read in %d "
+				"transfers of %d batches; waited %d, %d refused ]\n",
+				(int) simos->swap->outs,
+				(int) simos->swap->ins,
+				(int) simos->swap->cached,
+				(int) simos->swap->prefetches,
+				(int) simos->swap->cells_out,
+				(int) simos->swap->cells_in,
+				(int) simos->swap->runs,
+				(int) simos->swap->batches,
+				(int) simos->swap->stall,
+				(int) simos->swap->failures);
+		/*
+		 * forgotten after the report, not before the execution: the
+		 * page-outs of the admission are part of the first one
+		 */
+		simos_swap_reset(simos->swap);
+	}
+
+	if (simos->numa) {
+		for (i = 0; i < simos->numa->nnodes; i++) {
+			printf("[ Node %d: %d of %d cells, %d allocations, %d "
+					"elsewhere, %d refused ]\n", i,
+					(int) simos_numa_used(simos->numa, simos->mem, i),
+					(int) simos->numa->node[i].size,
+					(int) simos->numa->node[i].allocs,
+					(int) simos->numa->node[i].fallbacks,
+					(int) simos->numa->node[i].failures);
+		}
+		printf("[ NUMA: %d ticks on local memory, %d on remote memory "
+				"costing %d ]\n", (int) simos->numa->local,
+				(int) simos->numa->remote, (int) simos->numa->cost);
+	}
+
+	if (simos->groups) {
+		simos_group_report(simos->groups, 0);
+	}
+
+	if (simos->dvfs) {
+		for (i = 0; i < simos->dvfs->ncpus; i++) {
+			printf("[ CPU %d: busy %d of %d, %d changes of frequency;", i,
+					(int) simos->dvfs->cpu[i].busy,
+					(int) (simostime - simos->dvfs->start),
+					(int) simos->dvfs->cpu[i].transitions);
+			for (j = 0; j < simos->dvfs->nlevels; j++) {
+				printf(" %d MHz %d%%", (int) simos->dvfs->level[j].freq,
+						simos->dvfs->cpu[i].busy
+						? (int) (100 * simos->dvfs->cpu[i].time_at[j]
+							/ simos->dvfs->cpu[i].busy) : 0);
+			}
+			printf(" ]\n");
+		}
+
+		energy = simos_dvfs_energy(simos->dvfs, simostime);
+		printf("[ Energy: %d mJ, %d mW on average; %d units of work "
+				"per joule ]\n", (int) (energy / 1000),
+				simostime > simos->dvfs->start ? (int) (energy
+					/ (simostime - simos->dvfs->start)) : 0,
+				energy ? (int) (work * 1000000 / energy) : 0);
+	}
+
+	if (simos->bank) {
+		printf("[ Banker: %d requests, %d granted (%d without a safety "
+				"check), %d unsafe, %d unavailable ]\n",
+				(int) simos->bank->requests,
+				(int) simos->bank->granted,
+				(int) simos->bank->shortcuts,
+				(int) simos->bank->unsafe,
+				(int) simos->bank->unavailable);
+	}
+
+	if (simos->mem->stats->interval) {
+		sprintf(fname, "./out_mem%s%d%d%d%d.csv", algname,
+				conf->sort_sjf, conf->sort_srtf,
+				conf->priority, conf->auto_quantum);
+
+		f = fopen(fname, "w+");
+		simos_memory_stats_write(simos->mem, f);
+		fclose(f);
+	}
+
 	//Reset conf
 	conf->sort_sjf = 0;
 	conf->sort_srtf = 0;
@@ -138,14 +722,53 @@ void simos_execute(simos_t *simos, simos_scheduler_conf_t *conf,
 	conf->priority = 0;
 
 	simos->sched->ready = finished;
+
+	/* processes admitted too late for the policy to run them */
+	while ((n = simos_list_del_head(ready)) != NULL) {
+		n->next = n->prev = NULL;
+		simos_list_add(finished, n);
+	}
+	free(ready);
+
 	simos_list_sort(simos->sched->ready, &get_pid);
 }
 
 /** After execution, the memory must be freed. */
 void simos_free(simos_t *simos)
 {
+	if (simos->paging) {
+		simos_paging_destroy(simos->paging);
+	}
+	if (simos->cache) {
+		simos_cache_destroy(simos->cache);
+	}
+	if (simos->io) {
+		simos_io_destroy(simos->io);
+	}
+	if (simos->bank) {
+		simos_bank_destroy(simos->bank);
+	}
+	if (simos->swap) {
+		simos_swap_destroy(simos->swap);
+	}
+	if (simos->numa) {
+		simos_numa_destroy(simos->numa);
+	}
+	if (simos->groups) {
+		simos_group_destroy(simos->groups);
+	}
+	if (simos->dvfs) {
+		simos_dvfs_destroy(simos->dvfs);
+	}
+	simos_wheel_free(simos->timers);
+	if (simos->mem->compact) {
+		simos_memory_compact_destroy(simos->mem->compact);
+	}
 	simos_memory_destroy(simos->mem);
 	simos_list_free(simos->sched->ready);
+	/* never admitted, not in the ready list */
+	simos_list_free(simos->pending);
+	free(simos->pending);
 }
 
 
@@ -0,0 +1,509 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 ljr-ifsp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "simos.h"
+
+simos_swap_t *simos_swap_create(const char *path, size_t size, size_t batch,
+		size_t latency, size_t bandwidth)
+{
+	simos_swap_t *swap;
+	int fd;
+
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		return NULL;
+	}
+	if (ftruncate(fd, size) < 0) {
+		close(fd);
+		unlink(path);
+		return NULL;
+	}
+	unlink(path);
+
+	swap = malloc(sizeof(simos_swap_t));
+	swap->fd = fd;
+	swap->size = size;
+	swap->map = calloc(size, 1);
+	swap->queue = simos_list_new();
+	swap->queued = 0;
+	swap->batch = batch ? batch : 1;
+	swap->inflight = simos_list_new();
+	swap->busy_until = 0;
+	swap->latency = latency;
+	swap->bandwidth = bandwidth ? bandwidth : 1;
+
+	swap->procs = NULL;
+	swap->nprocs = 0;
+	swap->hand = 0;
+
+	simos_swap_reset(swap);
+	return swap;
+}
+
+void simos_swap_destroy(simos_swap_t *swap)
+{
+	simos_swap_drain(swap);
+	close(swap->fd);
+	free(swap->map);
+	free(swap->queue);
+	free(swap->inflight);
+	free(swap->procs);
+	free(swap);
+}
+
+void simos_swap_add(simos_swap_t *swap, simos_process_t *proc)
+{
+	swap->procs = realloc(swap->procs,
+			(swap->nprocs + 1) * sizeof(simos_process_t *));
+	swap->procs[swap->nprocs++] = proc;
+}
+
+/** First fit of `len' slots in the file, -1 if none. */
+static size_t simos_swap_slot_alloc(simos_swap_t *swap, size_t len)
+{
+	size_t i, run = 0;
+
+	for (i = 0; i < swap->size; i++) {
+		run = swap->map[i] ? 0 : run + 1;
+		if (run == len) {
+			memset(swap->map + i + 1 - len, 1, len);
+			return i + 1 - len;
+		}
+	}
+	return -1;
+}
+
+static void simos_swap_slot_free(simos_swap_t *swap, size_t slot, size_t len)
+{
+	memset(swap->map + slot, 0, len);
+}
+
+static int simos_swap_cmp(const void *a, const void *b)
+{
+	const simos_swap_req_t *x = *(simos_swap_req_t * const *) a;
+	const simos_swap_req_t *y = *(simos_swap_req_t * const *) b;
+
+	return (x->slot > y->slot) - (x->slot < y->slot);
+}
+
+/** Buffers of a request: a page-out has one, a page-in is read in place. */
+static int simos_swap_iov(simos_memory_t *mem, simos_swap_req_t *r,
+		struct iovec *iov)
+{
+	simos_process_t *p = r->proc;
+	int n = 0;
+
+	if (r->dir == SIMOS_SWAP_OUT) {
+		iov[0].iov_base = r->data;
+		iov[0].iov_len = r->len;
+		return 1;
+	}
+
+	if (p->required_memory) {
+		iov[n].iov_base = mem->cells + p->memory_pointer;
+		iov[n++].iov_len = p->required_memory;
+	}
+	if (p->mmap_pointer != (size_t) -1 && p->mmap_len) {
+		iov[n].iov_base = mem->cells + p->mmap_pointer;
+		iov[n++].iov_len = p->mmap_len;
+	}
+	return n;
+}
+
+/**
+ * Submit the page-in `in', or else the queued page-outs as a batch sorted
+ * by slot. A run of contiguous slots is a single transfer paying
+ * `latency' once.
+ */
+static void simos_swap_submit(simos_swap_t *swap, simos_memory_t *mem,
+		simos_swap_req_t *in, size_t now)
+{
+	simos_swap_req_t **batch;
+	simos_list_node_t *n;
+	struct iovec *iov;
+	size_t len, i, j, k, cells, t;
+	int niov;
+
+	len = in ? 1 : swap->queued;
+	if (len == 0) {
+		return;
+	}
+
+	batch = malloc(len * sizeof(simos_swap_req_t *));
+	iov = malloc(2 * len * sizeof(struct iovec));
+	if (in) {
+		batch[0] = in;
+	} else {
+		for (i = 0; (n = simos_list_del_head(swap->queue)) != NULL; i++) {
+			n->next = n->prev = NULL;
+			batch[i] = n->data;
+		}
+		swap->queued = 0;
+	}
+	qsort(batch, len, sizeof(simos_swap_req_t *), &simos_swap_cmp);
+
+	t = (swap->busy_until > now) ? swap->busy_until : now;
+	for (i = 0; i < len; i = j) {
+		niov = 0;
+		cells = 0;
+		for (j = i; j < len; j++) {
+			if (j > i && batch[j]->slot != batch[j - 1]->slot
+					+ batch[j - 1]->len) {
+				break;
+			}
+			niov += simos_swap_iov(mem, batch[j], iov + niov);
+			cells += batch[j]->len;
+		}
+
+		if (batch[i]->dir == SIMOS_SWAP_OUT) {
+			pwritev(swap->fd, iov, niov, batch[i]->slot);
+		} else {
+			preadv(swap->fd, iov, niov, batch[i]->slot);
+		}
+
+		t += swap->latency + (cells + swap->bandwidth - 1) / swap->bandwidth;
+		for (k = i; k < j; k++) {
+			batch[k]->done_at = t;
+			simos_list_add(swap->inflight, &batch[k]->node);
+		}
+		swap->runs++;
+	}
+	swap->busy_until = t;
+	swap->batches++;
+
+	free(iov);
+	free(batch);
+}
+
+void simos_swap_complete(simos_swap_t *swap, size_t now)
+{
+	simos_list_node_t *n;
+	simos_swap_req_t *r;
+
+	while ((n = swap->inflight->head) != NULL) {
+		r = n->data;
+		if (r->done_at > now) {
+			break;
+		}
+		simos_list_unlink(swap->inflight, n);
+
+		if (r->dir == SIMOS_SWAP_IN) {
+			/* the process is back, its slots are free again */
+			simos_swap_slot_free(swap, r->slot, r->len);
+			r->proc->swap_slot = -1;
+			r->proc->swap_req = NULL;
+		} else if (r->proc) {
+			r->proc->swap_req = NULL;
+		} else {
+			simos_swap_slot_free(swap, r->slot, r->len);
+		}
+		free(r->data);
+		free(r);
+	}
+}
+
+int simos_swap_out(simos_swap_t *swap, simos_memory_t *mem,
+		simos_process_t *proc, size_t now)
+{
+	simos_swap_req_t *r;
+	size_t len = 0, mlen = 0, slot;
+
+	if (proc->memory_pointer != (size_t) -1) {
+		len = proc->required_memory;
+	}
+	if (proc->mmap_pointer != (size_t) -1) {
+		mlen = proc->mmap_len;
+	}
+	if (len + mlen == 0 || proc->swap_req) {
+		return 0;
+	}
+
+	slot = simos_swap_slot_alloc(swap, len + mlen);
+	if (slot == (size_t) -1) {
+		swap->failures++;
+		return 0;
+	}
+
+	r = malloc(sizeof(simos_swap_req_t));
+	r->dir = SIMOS_SWAP_OUT;
+	r->proc = proc;
+	r->slot = slot;
+	r->len = len + mlen;
+	r->data = malloc(len + mlen);
+	r->done_at = -1;
+	r->node.data = r;
+	r->node.next = r->node.prev = NULL;
+
+	if (len) {
+		memcpy(r->data, mem->cells + proc->memory_pointer, len);
+		simos_memory_free(mem, proc->memory_pointer, len);
+		simos_memory_resync_range(mem, proc->memory_pointer, len);
+	}
+	if (mlen) {
+		memcpy(r->data + len, mem->cells + proc->mmap_pointer, mlen);
+		simos_memory_free(mem, proc->mmap_pointer, mlen);
+		simos_memory_resync_range(mem, proc->mmap_pointer, mlen);
+	}
+
+	proc->memory_pointer = -1;
+	proc->mmap_pointer = -1;
+	proc->swap_slot = slot;
+	proc->swap_req = r;
+
+	swap->outs++;
+	swap->cells_out += len + mlen;
+
+	simos_list_add(swap->queue, &r->node);
+	if (++swap->queued >= swap->batch) {
+		simos_swap_submit(swap, mem, NULL, now);
+	}
+	return 1;
+}
+
+/** Resident process run least recently, but `keep'. NULL if none. */
+static simos_process_t *simos_swap_victim(simos_swap_t *swap,
+		simos_process_t *keep)
+{
+	simos_process_t *p, *victim = NULL;
+	size_t i;
+
+	for (i = 0; i < swap->nprocs; i++) {
+		p = swap->procs[i];
+		if (p == keep || p->swap_req || p->swap_slot != (size_t) -1) {
+			continue;
+		}
+		if (p->memory_pointer == (size_t) -1
+				&& p->mmap_pointer == (size_t) -1) {
+			continue;
+		}
+		if (victim == NULL || p->last_run < victim->last_run) {
+			victim = p;
+		}
+	}
+	return victim;
+}
+
+int simos_swap_evict(simos_swap_t *swap, simos_memory_t *mem,
+		simos_process_t *keep, size_t now)
+{
+	simos_process_t *victim = simos_swap_victim(swap, keep);
+
+	return victim && simos_swap_out(swap, mem, victim, now);
+}
+
+size_t simos_swap_alloc(simos_swap_t *swap, simos_memory_t *mem, size_t len,
+		simos_process_t *keep, size_t now)
+{
+	size_t pointer;
+
+	for (;;) {
+		pointer = p_simos_memory_alloc ? p_simos_memory_alloc(mem, len)
+			: simos_memory_alloc(mem, len);
+		if (pointer != (size_t) -1) {
+			return pointer;
+		}
+
+		if (! simos_swap_evict(swap, mem, keep, now)) {
+			return -1;
+		}
+	}
+}
+
+/**
+ * Take back the cells of the process: at most `evict' processes may be
+ * swapped out for them. Return true or false.
+ */
+static int simos_swap_place(simos_swap_t *swap, simos_memory_t *mem,
+		simos_process_t *proc, size_t mlen, int evict, size_t now)
+{
+	size_t len = proc->required_memory, pointer;
+
+	pointer = evict ? simos_swap_alloc(swap, mem, len, proc, now)
+		: (p_simos_memory_alloc ? p_simos_memory_alloc(mem, len)
+				: simos_memory_alloc(mem, len));
+	if (pointer == (size_t) -1) {
+		return 0;
+	}
+	proc->memory_pointer = pointer;
+
+	if (mlen == 0) {
+		return 1;
+	}
+
+	pointer = evict ? simos_swap_alloc(swap, mem, mlen, proc, now)
+		: (p_simos_memory_alloc ? p_simos_memory_alloc(mem, mlen)
+				: simos_memory_alloc(mem, mlen));
+	if (pointer == (size_t) -1) {
+		simos_memory_free(mem, proc->memory_pointer, len);
+		simos_memory_resync_range(mem, proc->memory_pointer, len);
+		proc->memory_pointer = -1;
+		return 0;
+	}
+	proc->mmap_pointer = pointer;
+	return 1;
+}
+
+/** Page-in of the process, evicting others whether `evict'. */
+static int simos_swap_fetch(simos_swap_t *swap, simos_memory_t *mem,
+		simos_process_t *proc, int evict, size_t now)
+{
+	simos_swap_req_t *r = proc->swap_req;
+	size_t len = proc->required_memory;
+
+	if (proc->swap_slot == (size_t) -1) {
+		return 1;
+	}
+	if (r && r->dir == SIMOS_SWAP_IN) {
+		return 1;
+	}
+
+	if (! simos_swap_place(swap, mem, proc, r ? r->len - len
+				: proc->mmap_len, evict, now)) {
+		if (evict) {
+			swap->failures++;
+		}
+		return 0;
+	}
+	swap->ins++;
+	swap->cells_in += len + (r ? r->len - len : proc->mmap_len);
+
+	if (r) {
+		/* still in the swap cache: no need to read it */
+		memcpy(mem->cells + proc->memory_pointer, r->data, len);
+		if (r->len > len) {
+			memcpy(mem->cells + proc->mmap_pointer, r->data + len,
+					r->len - len);
+		}
+		if (r->done_at == (size_t) -1) {
+			simos_list_unlink(swap->queue, &r->node);
+			swap->queued--;
+			simos_swap_slot_free(swap, r->slot, r->len);
+			free(r->data);
+			free(r);
+		} else {
+			r->proc = NULL;
+		}
+		proc->swap_slot = -1;
+		proc->swap_req = NULL;
+		swap->cached++;
+		return 1;
+	}
+
+	r = malloc(sizeof(simos_swap_req_t));
+	r->dir = SIMOS_SWAP_IN;
+	r->proc = proc;
+	r->slot = proc->swap_slot;
+	r->len = len + proc->mmap_len;
+	r->data = NULL;
+	r->done_at = -1;
+	r->node.data = r;
+	r->node.next = r->node.prev = NULL;
+	proc->swap_req = r;
+
+	simos_swap_submit(swap, mem, r, now);
+	return 1;
+}
+
+int simos_swap_in(simos_swap_t *swap, simos_memory_t *mem,
+		simos_process_t *proc, size_t now)
+{
+	return simos_swap_fetch(swap, mem, proc, 1, now);
+}
+
+size_t simos_swap_tick(simos_swap_t *swap, simos_memory_t *mem,
+		simos_process_t *proc, size_t now)
+{
+	simos_process_t *p;
+	size_t wait = 0, i;
+
+	simos_swap_complete(swap, now);
+
+	/* cells are neither taken nor given back while compacting */
+	if (mem->compact && mem->compact->running) {
+		return 0;
+	}
+
+	if (proc && proc->swap_slot != (size_t) -1) {
+		if (simos_swap_in(swap, mem, proc, now) && proc->swap_req) {
+			wait = proc->swap_req->done_at - now;
+			simos_swap_complete(swap, proc->swap_req->done_at);
+			proc->swap_time += wait;
+			swap->stall += wait;
+			now += wait;
+		}
+	}
+
+	if (swap->busy_until > now) {
+		return wait;
+	}
+
+	/* the device is idle: read ahead whoever fits */
+	for (i = 0; i < swap->nprocs; i++) {
+		p = swap->procs[(swap->hand + i) % swap->nprocs];
+		if (p->swap_slot != (size_t) -1 && p->swap_req == NULL) {
+			if (simos_swap_fetch(swap, mem, p, 0, now)) {
+				swap->prefetches++;
+			}
+			swap->hand = (swap->hand + i + 1) % swap->nprocs;
+			break;
+		}
+	}
+
+	return wait;
+}
+
+void simos_swap_drain(simos_swap_t *swap)
+{
+	simos_list_node_t *n;
+	simos_swap_req_t *r;
+
+	/* nothing queued is read in place, the memory is not needed */
+	if (swap->queued) {
+		simos_swap_submit(swap, NULL, NULL, swap->busy_until);
+	}
+	SIMOS_LIST_FOREACH(n, swap->inflight) {
+		r = n->data;
+		r->done_at = 0;
+	}
+	simos_swap_complete(swap, 0);
+	swap->busy_until = 0;
+}
+
+void simos_swap_reset(simos_swap_t *swap)
+{
+	swap->outs = 0;
+	swap->ins = 0;
+	swap->cached = 0;
+	swap->prefetches = 0;
+	swap->cells_out = 0;
+	swap->cells_in = 0;
+	swap->runs = 0;
+	swap->batches = 0;
+	swap->stall = 0;
+	swap->failures = 0;
+}
@@ -0,0 +1,289 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 ljr-ifsp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <stdlib.h>
+#include <malloc.h>
+#include "simos.h"
+
+static simos_sync_t *simos_sync_new(int type)
+{
+	simos_sync_t *s = malloc(sizeof(simos_sync_t));
+
+	s->type = type;
+	s->count = 0;
+	s->owner = NULL;
+	s->held_next = NULL;
+	s->inherit = 0;
+	s->mutex = NULL;
+	s->waiters = simos_list_new();
+
+	s->acquisitions = 0;
+	s->contentions = 0;
+	s->boosts = 0;
+	s->deadlocks = 0;
+
+	return s;
+}
+
+simos_sync_t *simos_mutex_new(int inherit)
+{
+	simos_sync_t *m = simos_sync_new(SIMOS_SYNC_MUTEX);
+
+	m->inherit = inherit;
+	return m;
+}
+
+simos_sync_t *simos_sem_new(int count)
+{
+	simos_sync_t *s = simos_sync_new(SIMOS_SYNC_SEM);
+
+	s->count = count;
+	return s;
+}
+
+simos_sync_t *simos_cond_new()
+{
+	return simos_sync_new(SIMOS_SYNC_COND);
+}
+
+/** Free the object, its waiters are left alone. */
+void simos_sync_destroy(simos_sync_t *s)
+{
+	free(s->waiters);
+	free(s);
+}
+
+/** Queue the node to wait on the object. */
+static void simos_sync_block(simos_sync_t *s, simos_list_node_t *node,
+		size_t now)
+{
+	simos_process_t *p = simos_node_to_process(node);
+
+	p->waiting_on = s;
+	p->state = SIMOS_BLOCKED;
+	p->sync_time -= now; // the rest is added when woken
+	s->contentions++;
+
+	node->next = node->prev = NULL;
+	simos_list_add(s->waiters, node);
+}
+
+/** Take the first waiter out of the object, NULL if none. */
+static simos_list_node_t *simos_sync_wake(simos_sync_t *s, size_t now)
+{
+	simos_list_node_t *node = simos_list_del_head(s->waiters);
+	simos_process_t *p;
+
+	if (node) {
+		node->next = node->prev = NULL;
+		p = simos_node_to_process(node);
+		p->waiting_on = NULL;
+		p->state = SIMOS_READY;
+		p->sync_time += now;
+	}
+
+	return node;
+}
+
+/*****************************************************************
+ * mutex
+ *
+ * Every blocked process waits for at most one mutex, and a mutex has a
+ * single owner, so the wait-for graph is a set of chains: a new edge
+ * closes a cycle only if its chain of owners leads back to the process.
+ ****************************************************************/
+
+/** Priority of the process raised to the one of the waiters. */
+static void simos_mutex_raise(simos_process_t *p, simos_sync_t *m)
+{
+	simos_list_node_t *n;
+
+	SIMOS_LIST_FOREACH(n, m->waiters) {
+		if (simos_node_to_process(n)->priority < p->priority) {
+			p->priority = simos_node_to_process(n)->priority;
+		}
+	}
+}
+
+/** The process becomes the owner. */
+static void simos_mutex_take(simos_sync_t *m, simos_process_t *p)
+{
+	if (p->held == NULL) {
+		p->base_priority = p->priority;
+	}
+
+	m->owner = p;
+	m->held_next = p->held;
+	p->held = m;
+	m->acquisitions++;
+
+	if (m->inherit) {
+		simos_mutex_raise(p, m);
+	}
+}
+
+/** Queue the node on the mutex, the owners inherit its priority. */
+static void simos_mutex_wait(simos_sync_t *m, simos_list_node_t *node,
+		size_t now)
+{
+	simos_process_t *p = simos_node_to_process(node);
+	simos_process_t *o;
+
+	simos_sync_block(m, node, now);
+
+	for (o = m->owner; m->inherit && o && o->priority > p->priority; ) {
+		o->priority = p->priority;
+		m->boosts++;
+		if (o->waiting_on == NULL
+				|| o->waiting_on->type != SIMOS_SYNC_MUTEX) {
+			break;
+		}
+		o = o->waiting_on->owner;
+	}
+}
+
+/** Take the mutex for the process in the node. */
+int simos_mutex_lock(simos_sync_t *m, simos_list_node_t *node, size_t now)
+{
+	simos_process_t *p = simos_node_to_process(node);
+	simos_process_t *o;
+
+	if (m->owner == NULL) {
+		simos_mutex_take(m, p);
+		return 1;
+	}
+
+	/* the new edge p -> owner closes a cycle whether the chain of
+	 * owners comes back to p */
+	for (o = m->owner; o; o = o->waiting_on->owner) {
+		if (o == p) {
+			m->deadlocks++;
+			return -1;
+		}
+		if (o->waiting_on == NULL
+				|| o->waiting_on->type != SIMOS_SYNC_MUTEX) {
+			break;
+		}
+	}
+
+	simos_mutex_wait(m, node, now);
+	return 0;
+}
+
+/** Release the mutex, it goes right to the first waiter. */
+simos_list_node_t *simos_mutex_unlock(simos_sync_t *m, size_t now)
+{
+	simos_process_t *o = m->owner;
+	simos_sync_t **link, *h;
+	simos_list_node_t *node;
+
+	if (o == NULL) {
+		return NULL;
+	}
+
+	for (link = &o->held; *link != m; link = &(*link)->held_next);
+	*link = m->held_next;
+	m->held_next = NULL;
+	m->owner = NULL;
+
+	/* back to its own priority, or the one inherited by the others */
+	if (m->inherit) {
+		o->priority = o->base_priority;
+		for (h = o->held; h; h = h->held_next) {
+			if (h->inherit) {
+				simos_mutex_raise(o, h);
+			}
+		}
+	}
+
+	node = simos_sync_wake(m, now);
+	if (node) {
+		simos_mutex_take(m, simos_node_to_process(node));
+	}
+
+	return node;
+}
+
+/*****************************************************************
+ * semaphore
+ ****************************************************************/
+
+int simos_sem_wait(simos_sync_t *s, simos_list_node_t *node, size_t now)
+{
+	if (s->count > 0) {
+		s->count--;
+		s->acquisitions++;
+		return 1;
+	}
+
+	simos_sync_block(s, node, now);
+	return 0;
+}
+
+/** Release the semaphore, straight to a waiter if any. */
+simos_list_node_t *simos_sem_post(simos_sync_t *s, size_t now)
+{
+	simos_list_node_t *node = simos_sync_wake(s, now);
+
+	if (node) {
+		s->acquisitions++;
+	} else {
+		s->count++;
+	}
+
+	return node;
+}
+
+/*****************************************************************
+ * condition variable
+ ****************************************************************/
+
+/** Release the mutex and wait on the condition variable. */
+simos_list_node_t *simos_cond_wait(simos_sync_t *c, simos_sync_t *m,
+		simos_list_node_t *node, size_t now)
+{
+	simos_list_node_t *woken = simos_mutex_unlock(m, now);
+
+	c->mutex = m;
+	simos_sync_block(c, node, now);
+
+	return woken;
+}
+
+/** Wake the first waiter, it takes its mutex back or waits for it. */
+simos_list_node_t *simos_cond_signal(simos_sync_t *c, size_t now)
+{
+	simos_list_node_t *node = simos_sync_wake(c, now);
+
+	if (node == NULL) {
+		return NULL;
+	}
+	c->acquisitions++;
+
+	if (c->mutex->owner == NULL) {
+		simos_mutex_take(c->mutex, simos_node_to_process(node));
+		return node;
+	}
+
+	simos_mutex_wait(c->mutex, node, now);
+	return NULL;
+}
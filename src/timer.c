@@ -0,0 +1,274 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 ljr-ifsp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <stdlib.h>
+#include <malloc.h>
+#include "simos.h"
+
+#define SIMOS_WHEEL_MASK (SIMOS_WHEEL_SIZE - 1)
+/** Bits of time below level l. */
+#define SIMOS_WHEEL_SHIFT(l) ((l) * SIMOS_WHEEL_BITS)
+
+/** Create an empty wheel whose time is `now'. */
+simos_wheel_t *simos_wheel_new(size_t now)
+{
+	simos_wheel_t *w = malloc(sizeof(simos_wheel_t));
+	int l, i;
+
+	for (l = 0; l < SIMOS_WHEEL_LEVELS; l++) {
+		for (i = 0; i < SIMOS_WHEEL_SIZE; i++) {
+			w->slot[l][i] = NULL;
+		}
+		w->nonempty[l] = 0;
+	}
+	w->expired = NULL;
+	w->next = now;
+	w->next_event = -1;
+	w->count = 0;
+
+	return w;
+}
+
+/** Free the wheel, not the timers. */
+void simos_wheel_free(simos_wheel_t *w)
+{
+	free(w);
+}
+
+/** Prepare a timer calling fn(arg, now) when it expires. */
+void simos_timer_init(simos_timer_t *t, void (* fn)(void *arg, size_t now),
+		void *arg)
+{
+	t->expires = 0;
+	t->fn = fn;
+	t->arg = arg;
+	t->next = t->prev = NULL;
+	t->level = -1;
+	t->slot = -1;
+}
+
+/** Link the timer in the slot of its level, by how far it is. */
+static void simos_wheel_link(simos_wheel_t *w, simos_timer_t *t)
+{
+	size_t expires = t->expires < w->next ? w->next : t->expires;
+	size_t delta = expires - w->next;
+	int l = 0;
+
+	while (l < SIMOS_WHEEL_LEVELS - 1
+			&& (delta >> SIMOS_WHEEL_SHIFT(l + 1))) {
+		l++;
+	}
+
+	/* beyond the last level: wait in its farthest slot */
+	if (delta >> SIMOS_WHEEL_SHIFT(SIMOS_WHEEL_LEVELS)) {
+		expires = w->next + ((size_t) SIMOS_WHEEL_MASK
+				<< SIMOS_WHEEL_SHIFT(SIMOS_WHEEL_LEVELS - 1));
+	}
+
+	t->level = l;
+	t->slot = (expires >> SIMOS_WHEEL_SHIFT(l)) & SIMOS_WHEEL_MASK;
+	t->prev = NULL;
+	t->next = w->slot[l][t->slot];
+	if (t->next) {
+		t->next->prev = t;
+	}
+	w->slot[l][t->slot] = t;
+	w->nonempty[l] |= 1UL << t->slot;
+}
+
+static void simos_wheel_unlink(simos_wheel_t *w, simos_timer_t *t)
+{
+	if (t->prev) {
+		t->prev->next = t->next;
+	} else if (t->level == SIMOS_WHEEL_LEVELS) {
+		w->expired = t->next;
+	} else {
+		w->slot[t->level][t->slot] = t->next;
+		if (t->next == NULL) {
+			w->nonempty[t->level] &= ~(1UL << t->slot);
+		}
+	}
+
+	if (t->next) {
+		t->next->prev = t->prev;
+	}
+
+	t->next = t->prev = NULL;
+	t->level = -1;
+	t->slot = -1;
+}
+
+/** Drop every pending timer and start the wheel over at `now'. */
+void simos_wheel_reset(simos_wheel_t *w, size_t now)
+{
+	simos_timer_t *t;
+	int l, i;
+
+	for (l = 0; l < SIMOS_WHEEL_LEVELS; l++) {
+		for (i = 0; i < SIMOS_WHEEL_SIZE; i++) {
+			while ((t = w->slot[l][i]) != NULL) {
+				simos_wheel_unlink(w, t);
+			}
+		}
+	}
+	w->expired = NULL;
+	w->next = now;
+	w->next_event = -1;
+	w->count = 0;
+}
+
+/**
+ * Time slot `i' of level l comes: the first time from w->next on whose
+ * bits below the level are zero and whose level bits are i.
+ */
+static size_t simos_wheel_when(simos_wheel_t *w, int l, int i)
+{
+	size_t unit = (w->next + ((size_t) 1 << SIMOS_WHEEL_SHIFT(l)) - 1)
+		>> SIMOS_WHEEL_SHIFT(l);
+
+	unit += (i - unit) & SIMOS_WHEEL_MASK;
+	return unit << SIMOS_WHEEL_SHIFT(l);
+}
+
+/** Time of the next slot holding timers, -1 if none. */
+size_t simos_wheel_next(simos_wheel_t *w)
+{
+	size_t unit, when, first = -1;
+	unsigned long ring;
+	int l, shift;
+
+	for (l = 0; l < SIMOS_WHEEL_LEVELS; l++) {
+		if (! w->nonempty[l]) {
+			continue;
+		}
+
+		/* the nearest slot is the first bit from the current one */
+		unit = (w->next + ((size_t) 1 << SIMOS_WHEEL_SHIFT(l)) - 1)
+			>> SIMOS_WHEEL_SHIFT(l);
+		shift = unit & SIMOS_WHEEL_MASK;
+		ring = shift ? (w->nonempty[l] >> shift)
+			| (w->nonempty[l] << (SIMOS_WHEEL_SIZE - shift))
+			: w->nonempty[l];
+		when = simos_wheel_when(w, l, (shift + __builtin_ctzl(ring))
+				& SIMOS_WHEEL_MASK);
+
+		if (when < first) {
+			first = when;
+		}
+	}
+
+	return first;
+}
+
+/** Add the timer, or move it whether pending. O(1). */
+void simos_wheel_add(simos_wheel_t *w, simos_timer_t *t, size_t expires)
+{
+	if (t->level >= 0) {
+		simos_wheel_unlink(w, t);
+		w->count--;
+	}
+
+	t->expires = expires;
+	simos_wheel_link(w, t);
+	w->count++;
+
+	if (expires < w->next_event) {
+		w->next_event = expires < w->next ? w->next : expires;
+	}
+}
+
+/** Remove a pending timer, O(1). Return true or false. */
+int simos_wheel_del(simos_wheel_t *w, simos_timer_t *t)
+{
+	if (t->level < 0) {
+		return 0;
+	}
+
+	simos_wheel_unlink(w, t);
+	w->count--;
+	return 1;
+}
+
+/** Move every timer of slot `i' of level l to the levels below. */
+static void simos_wheel_cascade(simos_wheel_t *w, int l, int i)
+{
+	simos_timer_t *t = w->slot[l][i], *next;
+
+	w->slot[l][i] = NULL;
+	w->nonempty[l] &= ~(1UL << i);
+
+	for (; t; t = next) {
+		next = t->next;
+		simos_wheel_link(w, t);
+	}
+}
+
+/** Fire every timer expired by `now'. Return how many fired. */
+size_t simos_wheel_advance(simos_wheel_t *w, size_t now)
+{
+	simos_timer_t *t;
+	size_t when, fired = 0;
+	int l, i;
+
+	/* nothing to do between two events */
+	if (now < w->next_event || now < w->next) {
+		return 0;
+	}
+
+	while ((when = simos_wheel_next(w)) <= now) {
+		w->next = when;
+
+		/* at the turn of a level, its slot goes down */
+		for (l = 1; l < SIMOS_WHEEL_LEVELS; l++) {
+			if (when & (((size_t) 1 << SIMOS_WHEEL_SHIFT(l)) - 1)) {
+				break;
+			}
+			i = (when >> SIMOS_WHEEL_SHIFT(l)) & SIMOS_WHEEL_MASK;
+			simos_wheel_cascade(w, l, i);
+		}
+
+		/*
+		 * fire the slot as a batch: a timer added by a callback may
+		 * come to this slot again, for the next turn
+		 */
+		i = when & SIMOS_WHEEL_MASK;
+		w->next = when + 1;
+		w->expired = w->slot[0][i];
+		w->slot[0][i] = NULL;
+		w->nonempty[0] &= ~(1UL << i);
+		for (t = w->expired; t; t = t->next) {
+			t->level = SIMOS_WHEEL_LEVELS;
+		}
+
+		while ((t = w->expired) != NULL) {
+			simos_wheel_unlink(w, t);
+			w->count--;
+			fired++;
+			t->fn(t->arg, when);
+		}
+	}
+
+	w->next = now + 1;
+	w->next_event = simos_wheel_next(w);
+
+	return fired;
+}